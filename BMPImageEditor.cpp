@@ -3,6 +3,23 @@
 #include <cstdint>
 #include <vector>
 #include <string>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+#include <type_traits>
+#include <limits>
+#include <tuple>
+#include <array>
+#include <filesystem>
+
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
 
 class BMPImageEditor
 {
@@ -75,182 +92,5609 @@ private:
     // Флаг, обозначающий, открыл ли объект данного класса некоторый входной файл.
     bool fileWasRead = false;
 
-public:
-    BMPImageEditor() = default;
+    /*  Вспомогательный метод, который смешивает цвет source с цветом destination с непрозрачностью alpha
+        (0 -> остается destination, 255 -> получается source). Для каждого канала считается
+        (source * alpha + destination * (255 - alpha)) / 255, где деление на 255 заменено точной
+        целочисленной формулой t = x + 128, (t + (t >> 8)) >> 8. Синий и красный каналы лежат в битах
+        16-23 и 0-7, поэтому их можно обработать одним умножением (они не "перетекают" друг в друга).  */
+    static uint32_t blendColors(uint32_t destination, uint32_t source, uint32_t alpha)
+    {
+        uint32_t blue_and_red = (source & 0xFF'00FF) * alpha + (destination & 0xFF'00FF) * (255 - alpha) + 0x80'0080;
+        uint32_t green        = ((source >> 8) & 0xFF) * alpha + ((destination >> 8) & 0xFF) * (255 - alpha) + 0x80;
 
-    // Метод, позволяющий считать все данные из входного файла.
-    void read(const std::string& file_path) 
+        blue_and_red = ((blue_and_red + ((blue_and_red >> 8) & 0xFF'00FF)) >> 8) & 0xFF'00FF;
+        green        = ((green + (green >> 8)) >> 8) & 0xFF;
+
+        return blue_and_red | (green << 8);
+    }
+
+    /*  Вспомогательный метод (SIMD-ядро), который смешивает count пикселей source с пикселями destination
+        с непрозрачностью alpha. Если процессор поддерживает SSE2, то за одну итерацию обрабатываются
+        4 пикселя: байты расширяются до 16 бит, перемножаются и складываются, после чего результат
+        делится на 255 той же формулой, что и в blendColors. Оставшиеся пиксели смешиваются по одному.
+        Если source == nullptr, то вместо него используется один и тот же цвет color.  */
+    static void blendSpan(uint32_t* destination, const uint32_t* source, uint32_t color, int count, uint32_t alpha)
     {
-        // 1. Создаю входной поток для чтения входного файла.
-        std::ifstream inp_file(file_path);
+        int x = 0;
 
-        // 1.1 Если не смог открыть файл - выбрасываю исключение с соответствующим сообщением.
-        if (!inp_file) {
-            throw std::runtime_error("Error! It's not possible to open the file on the path: \"" + file_path + "\".");
+#if defined(__SSE2__)
+        const __m128i zero          = _mm_setzero_si128();
+        const __m128i rounding      = _mm_set1_epi16(128);
+        const __m128i source_weight = _mm_set1_epi16(static_cast<short>(alpha));
+        const __m128i dest_weight   = _mm_set1_epi16(static_cast<short>(255 - alpha));
+        const __m128i color_vector  = _mm_set1_epi32(static_cast<int>(color));
+
+        // Смешивает 8 каналов (два пикселя), расширенных до 16 бит.
+        auto blend_half = [&](__m128i dst, __m128i src)
+        {
+            __m128i t = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(src, source_weight),
+                                                    _mm_mullo_epi16(dst, dest_weight)), rounding);
+            return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+        };
+
+        for (; x + 4 <= count; x += 4)
+        {
+            __m128i dst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(destination + x));
+            __m128i src = source ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + x)) : color_vector;
+
+            __m128i low  = blend_half(_mm_unpacklo_epi8(dst, zero), _mm_unpacklo_epi8(src, zero));
+            __m128i high = blend_half(_mm_unpackhi_epi8(dst, zero), _mm_unpackhi_epi8(src, zero));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + x), _mm_packus_epi16(low, high));
         }
+#endif
 
-        /* 2.   Создаю функтор (с помощью лямбда-функции) для удобной проверки на возникновение ошибок при чтении файла.
-                При необходимости функтор выбрасывает исключение с соответствующим сообщением.  */
-        auto check_error = [&]() { if (inp_file.fail()) throw std::runtime_error("Oops! An error occurred while reading the file."); };
+        for (; x < count; ++x) { destination[x] = blendColors(destination[x], source ? source[x] : color, alpha); }
+    }
 
-        /* 3.   Считываю информацию из двух основных заголовков и заполняю поля объектов
-                моих структур соответствующей информацией. После чтения каждого блока проверяю наличие ошибок.   */
-        inp_file.read(reinterpret_cast<char*>(&file_header), sizeof(BMPFileHeader));
-        check_error();
+    /*  Вспомогательный метод (SIMD-ядро линейной таблицы): заменяет значение v каждого канала на
+        clamp((v * scales[канал] + offsets[канал]) >> shift, 0, 255) (каналы в порядке красный, зеленый, синий,
+        неиспользуемый байт). В SSE2-версии каналы 4 пикселей распаковываются в 16 бит, произведения
+        собираются в 32-битные числа, а обратная упаковка с насыщением сама обрезает результат до 0..255.  */
+    static void transformSpan(uint32_t* row, int count, const int16_t* scales, const int32_t* offsets, int shift)
+    {
+        int x = 0;
 
-        inp_file.read(reinterpret_cast<char*>(&info_block), sizeof(BMPFileInfoBlock));
-        check_error();
+#if defined(__SSE2__)
+        const __m128i zero  = _mm_setzero_si128();
+        const __m128i scale = _mm_setr_epi16(scales[0], scales[1], scales[2], scales[3], scales[0], scales[1], scales[2], scales[3]);
+        const __m128i offset = _mm_setr_epi32(offsets[0], offsets[1], offsets[2], offsets[3]);
+        const __m128i shift_vector = _mm_cvtsi32_si128(shift);
 
-        /* 3.1  После получения информации о входном файле, обрабатываю случаи, 
-                которые могут привести к *непредвиденному* поведению программы.  */
-        if (file_header.type_of_file != 0x4D42) {
-            throw std::runtime_error("Error! The specified file is not of the BMP type.");
+        for (; x + 4 <= count; x += 4)
+        {
+            __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+            __m128i halves[2] = { _mm_unpacklo_epi8(value, zero), _mm_unpackhi_epi8(value, zero) };
+            __m128i words[2];
+
+            for (int half = 0; half < 2; ++half)
+            {
+                __m128i low  = _mm_mullo_epi16(halves[half], scale);
+                __m128i high = _mm_mulhi_epi16(halves[half], scale);
+
+                __m128i first  = _mm_sra_epi32(_mm_add_epi32(_mm_unpacklo_epi16(low, high), offset), shift_vector);
+                __m128i second = _mm_sra_epi32(_mm_add_epi32(_mm_unpackhi_epi16(low, high), offset), shift_vector);
+
+                words[half] = _mm_packs_epi32(first, second);
+            }
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(row + x), _mm_packus_epi16(words[0], words[1]));
         }
+#endif
 
-        if (info_block.color_depth_in_bits != 24) {
-            throw std::runtime_error("Error! This class only works with images with a color depth of 24 bits.");
+        for (; x < count; ++x)
+        {
+            uint8_t* bytes = reinterpret_cast<uint8_t*>(row + x);
+            for (int c = 0; c < 4; ++c) { bytes[c] = static_cast<uint8_t>(std::clamp((bytes[c] * scales[c] + offsets[c]) >> shift, 0, 255)); }
         }
+    }
 
-        /* 4.   Внутри файла перемещаюсь к началу данных о пикселях.
-                На самом деле, в моем случае это не обязательно, так как позиция чтения 
-                и так находится перед информацией о пикселях, но все же стоит перестраховаться.   */
-        inp_file.seekg(file_header.offset_to_pixel_data, std::ios::beg);
+    /*  Вспомогательный метод (SIMD-ядро свертки): для каждого i из [0, count) вычисляет
+        result[i] = sum(weights[k] * sources[k][i]), k = 0..taps-1, где sources - набор указателей
+        на строки 16-битных значений (это могут быть разные строки или одна строка со сдвигами).
+        В SSE2-версии 8 произведений 16x16 бит считаются за раз, а суммы накапливаются в 32-битных
+        регистрах, поэтому промежуточные суммы не переполняются.  */
+    static void weightedSum(const int16_t* const* sources, const int16_t* weights, int taps, int count, int32_t* result)
+    {
+        int i = 0;
 
-        /* 5.   Так как данные о пикселях в файле обычно располагаются с учетом
-                выравнивания, то я рассчитываю реальный размер строки, учитывая вышеупомянутый момент.   */
-        int bytes_per_pixel = info_block.color_depth_in_bits / 8;
-        int row_size = (info_block.width * bytes_per_pixel + 3) & (~3);
+#if defined(__SSE2__)
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i low_sum  = _mm_setzero_si128();
+            __m128i high_sum = _mm_setzero_si128();
+
+            for (int k = 0; k < taps; ++k)
+            {
+                __m128i value  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sources[k] + i));
+                __m128i weight = _mm_set1_epi16(weights[k]);
 
-        // 6. Выделяю необходимую память для матрицы pixels.
-        pixels.resize(info_block.height, std::vector<uint32_t>(info_block.width));
+                // Младшие и старшие 16 бит произведений склеиваются в 32-битные числа.
+                __m128i product_low  = _mm_mullo_epi16(value, weight);
+                __m128i product_high = _mm_mulhi_epi16(value, weight);
 
-        // 7. Начинаю считывать информацию о пикселях:
-        for (int y = 0; y < info_block.height; ++y)
+                low_sum  = _mm_add_epi32(low_sum, _mm_unpacklo_epi16(product_low, product_high));
+                high_sum = _mm_add_epi32(high_sum, _mm_unpackhi_epi16(product_low, product_high));
+            }
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(result + i), low_sum);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(result + i + 4), high_sum);
+        }
+#endif
+
+        for (; i < count; ++i)
         {
-            /* 7.1  Определяю правильный индекс строки в изображении
-                    (иначе изображение выводится вверх ногами).  */
-            int row_index = info_block.height - y - 1;
+            int32_t sum = 0;
+            for (int k = 0; k < taps; ++k) { sum += static_cast<int32_t>(weights[k]) * sources[k][i]; }
+            result[i] = sum;
+        }
+    }
 
-            for (int x = 0; x < info_block.width; ++x)
-            {
-                /*  Напоминаю, каждый пиксель представлен 3 байтами:
-                    1-й байт -> синий, 2-й байт -> зеленый, 3-й байт -> красный.  */
-                uint8_t blue = 0, green = 0, red = 0;
+    /*  Вспомогательный метод, который распаковывает строку пикселей в 16-битные значения каналов
+        (по 4 значения на пиксель) и дополняет ее слева и справа копиями крайних пикселей
+        (pad_left и pad_right пикселей соответственно) - так свертке не нужны проверки границ.  */
+    static void expandRow(const uint32_t* row, int width, int pad_left, int pad_right, int16_t* result)
+    {
+        int16_t* output = result + 4 * pad_left;
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(row);
+        int i = 0;
+
+#if defined(__SSE2__)
+        for (; i + 16 <= 4 * width; i += 16)
+        {
+            __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + i));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_unpacklo_epi8(value, _mm_setzero_si128()));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i + 8), _mm_unpackhi_epi8(value, _mm_setzero_si128()));
+        }
+#endif
+
+        for (; i < 4 * width; ++i) { output[i] = bytes[i]; }
+
+        for (int x = 0; x < pad_left; ++x) { std::copy_n(output, 4, result + 4 * x); }
+        for (int x = 0; x < pad_right; ++x) { std::copy_n(output + 4 * (width - 1), 4, output + 4 * (width + x)); }
+    }
+
+    /*  Вспомогательный метод, который округляет суммы (делит на 2^shift) и упаковывает их в 16-битные
+        значения с насыщением (результат остается в формате с фиксированной точкой).  */
+    static void packSums(const int32_t* sums, int count, int shift, int16_t* result)
+    {
+        const int32_t rounding = (1 << shift) >> 1;
+        int i = 0;
+
+#if defined(__SSE2__)
+        const __m128i rounding_vector = _mm_set1_epi32(rounding);
+        const __m128i shift_vector    = _mm_cvtsi32_si128(shift);
+
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i low  = _mm_sra_epi32(_mm_add_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + i)), rounding_vector), shift_vector);
+            __m128i high = _mm_sra_epi32(_mm_add_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + i + 4)), rounding_vector), shift_vector);
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(result + i), _mm_packs_epi32(low, high));
+        }
+#endif
+
+        for (; i < count; ++i) { result[i] = static_cast<int16_t>(std::clamp((sums[i] + rounding) >> shift, -32768, 32767)); }
+    }
 
-                inp_file.read(reinterpret_cast<char*>(&blue), sizeof(uint8_t));
-                inp_file.read(reinterpret_cast<char*>(&green), sizeof(uint8_t));
-                inp_file.read(reinterpret_cast<char*>(&red), sizeof(uint8_t));
+    /*  Вспомогательный метод, который округляет суммы (делит на 2^shift), обрезает их до диапазона 0..255
+        и упаковывает обратно в пиксели (по 4 суммы на пиксель). Неиспользуемый старший байт пикселя обнуляется.  */
+    static void packPixels(const int32_t* sums, int width, int shift, uint32_t* row)
+    {
+        const int32_t rounding = (1 << shift) >> 1;
+        uint8_t* bytes = reinterpret_cast<uint8_t*>(row);
+        int i = 0;
 
-                //  nothing      blue        green        red
-                // 0000_0000 ' 0000_0000 ' 0000_0000 ' 0000_0000
-                uint32_t color = (blue << 16) | (green << 8) | red;
+#if defined(__SSE2__)
+        const __m128i rounding_vector = _mm_set1_epi32(rounding);
+        const __m128i shift_vector    = _mm_cvtsi32_si128(shift);
 
-                pixels[row_index][x] = color;
+        for (; i + 16 <= 4 * width; i += 16)
+        {
+            __m128i part[4];
+            for (int j = 0; j < 4; ++j) {
+                part[j] = _mm_sra_epi32(_mm_add_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + i + 4 * j)), rounding_vector), shift_vector);
             }
 
-            /* 7.2  Вычисляю количество байт выравнивания для
-                    данной строки и сдвигаю позицию чтения при необходимости.  */
-            int padding = row_size - (info_block.width * bytes_per_pixel);
-            if (padding > 0) { inp_file.seekg(padding, std::ios::cur); }
+            __m128i packed = _mm_packus_epi16(_mm_packs_epi32(part[0], part[1]), _mm_packs_epi32(part[2], part[3]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(bytes + i), packed);
         }
+#endif
 
-        // 8. Закрываю поток чтения входного файла и меняю флаг fileWasRead на соответствующее значение.
-        inp_file.close();
-        fileWasRead = true;
+        for (; i < 4 * width; ++i) { bytes[i] = static_cast<uint8_t>(std::clamp((sums[i] + rounding) >> shift, 0, 255)); }
+
+        for (int x = 0; x < width; ++x) { row[x] &= 0xFF'FFFF; }
     }
 
-    /*  Метод, позволяющий нарисовать крест на изображении. Пользователь может выбрать, 
-        каким цветом ему нарисовать крест -> для этого ему достаточно ввести BGR-последовательность
-        (по умолчанию - крест рисуется черным цветом).  */
-    void drawCross(uint8_t blue = 0, uint8_t green = 0, uint8_t red = 0)
-    {        
-        /* 1.   Если на момент вызова данной функции пользователь 
-                еще не считал данные из файла - выбрасываю исключение с соответствующим сообщением.   */
-        if (!fileWasRead) {
-            throw std::runtime_error("Error! First you need to read the data from the file.");
+    /*  Таблица весов ресемплинга вдоль одного измерения: выходной элемент i - это взвешенная сумма
+        taps исходных элементов, начиная с starts[i], с весами weights[i * taps .. (i + 1) * taps)
+        (формат с фиксированной точкой, сумма весов каждого элемента равна 1.0).  */
+    struct ResampleTable
+    {
+        int taps = 0;
+        std::vector<int32_t> starts;
+        std::vector<int16_t> weights;
+    };
+
+    /*  Вспомогательный метод (SIMD-ядро горизонтального ресемплинга): для каждого выходного пикселя x из
+        [0, count) считает 4 суммы каналов по таблице table и записывает их в sums[4 * x .. 4 * x + 4).
+        В SSE2-версии каналы двух соседних исходных пикселей чередуются в 16-битных значениях,
+        и одно умножение со сложением пар (_mm_madd_epi16) обрабатывает сразу два веса
+        (веса пары при этом подряд лежат в таблице и загружаются как одно 32-битное число).  */
+    static void resampleRow(const uint32_t* row, const ResampleTable& table, int count, int32_t* sums)
+    {
+        const int taps = table.taps;
+
+        for (int x = 0; x < count; ++x)
+        {
+            const uint32_t* source = row + table.starts[x];
+            const int16_t* weights = table.weights.data() + static_cast<size_t>(x) * taps;
+            int k = 0;
+
+#if defined(__SSE2__)
+            const __m128i zero = _mm_setzero_si128();
+            __m128i sum = _mm_setzero_si128();
+
+            // Четыре веса за раз: пиксели переставляются в порядок (a, c, b, d), после чего распаковка чередует a с b и c с d.
+            for (; k + 4 <= taps; k += 4)
+            {
+                __m128i quad = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + k)), _MM_SHUFFLE(3, 1, 2, 0));
+                quad = _mm_unpacklo_epi8(quad, _mm_srli_si128(quad, 8));
+
+                __m128i weight = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(weights + k));
+                sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_unpacklo_epi8(quad, zero), _mm_shuffle_epi32(weight, _MM_SHUFFLE(0, 0, 0, 0))));
+                sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_unpackhi_epi8(quad, zero), _mm_shuffle_epi32(weight, _MM_SHUFFLE(1, 1, 1, 1))));
+            }
+
+            for (; k + 2 <= taps; k += 2)
+            {
+                __m128i pair   = _mm_unpacklo_epi8(_mm_cvtsi32_si128(source[k]), _mm_cvtsi32_si128(source[k + 1]));
+                __m128i weight = _mm_set1_epi32(static_cast<uint16_t>(weights[k]) | (static_cast<uint32_t>(static_cast<uint16_t>(weights[k + 1])) << 16));
+                sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_unpacklo_epi8(pair, zero), weight));
+            }
+
+            if (k < taps)
+            {
+                __m128i single = _mm_unpacklo_epi8(_mm_cvtsi32_si128(source[k]), zero);
+                sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_unpacklo_epi16(single, zero), _mm_set1_epi32(static_cast<uint16_t>(weights[k]))));
+            }
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + 4 * x), sum);
+#else
+            int32_t sum[4] = { 0, 0, 0, 0 };
+
+            for (; k < taps; ++k)
+            {
+                const uint8_t* bytes = reinterpret_cast<const uint8_t*>(source + k);
+                for (int c = 0; c < 4; ++c) { sum[c] += static_cast<int32_t>(weights[k]) * bytes[c]; }
+            }
+
+            std::copy_n(sum, 4, sums + 4 * x);
+#endif
         }
+    }
 
-        // 2. Интерпретирую входные цвета как единое 4х-байтовое число.
-        uint32_t color = (blue << 16) | (green << 8) | red;
+    /*  Вспомогательный метод, который уменьшает пару строк top и bottom (ширины source_width) в 2 раза
+        по каждой оси: пиксель x результата - это округленное среднее пикселей 2x и 2x + 1 обеих строк
+        (при нечетной ширине последний столбец не участвует, при ширине 1 столбец берется дважды).
+        В скалярной версии синий и красный каналы складываются "по два в одном числе" (в двух 16-битных
+        половинах), а в SSE2-версии все каналы 4 выходных пикселей обрабатываются в 16-битных регистрах.  */
+    static void downsampleRows(const uint32_t* top, const uint32_t* bottom, int source_width, int width, uint32_t* result)
+    {
+        const uint32_t mask = 0x00FF'00FF;
 
-        // 3. Рисую крест, который проходит по главным диагоналям изображения.
-        for (int i = 0; i < std::min(info_block.height, info_block.width); ++i)
+        auto average = [mask](uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+        {
+            uint32_t blue_red = (a & mask) + (b & mask) + (c & mask) + (d & mask) + 0x0002'0002;
+            uint32_t green    = ((a >> 8) & 0xFF) + ((b >> 8) & 0xFF) + ((c >> 8) & 0xFF) + ((d >> 8) & 0xFF) + 2;
+
+            return ((blue_red >> 2) & mask) | ((green >> 2) << 8);
+        };
+
+        // Основной цикл без проверок границ, затем случай ширины 1.
+        int pairs = std::min(width, source_width / 2);
+        int x = 0;
+
+#if defined(__SSE2__)
+        // 4 выходных пикселя за раз: каналы распаковываются в 16 бит, строки складываются, затем соседние пиксели.
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i two  = _mm_set1_epi16(2);
+
+        for (; x + 4 <= pairs; x += 4)
+        {
+            __m128i sums[4];
+
+            for (int half = 0; half < 2; ++half)
+            {
+                __m128i upper = _mm_loadu_si128(reinterpret_cast<const __m128i*>(top + 2 * x + 4 * half));
+                __m128i lower = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + 2 * x + 4 * half));
+
+                sums[2 * half]     = _mm_add_epi16(_mm_unpacklo_epi8(upper, zero), _mm_unpacklo_epi8(lower, zero));
+                sums[2 * half + 1] = _mm_add_epi16(_mm_unpackhi_epi8(upper, zero), _mm_unpackhi_epi8(lower, zero));
+            }
+
+            __m128i first  = _mm_add_epi16(_mm_unpacklo_epi64(sums[0], sums[1]), _mm_unpackhi_epi64(sums[0], sums[1]));
+            __m128i second = _mm_add_epi16(_mm_unpacklo_epi64(sums[2], sums[3]), _mm_unpackhi_epi64(sums[2], sums[3]));
+
+            first  = _mm_srli_epi16(_mm_add_epi16(first, two), 2);
+            second = _mm_srli_epi16(_mm_add_epi16(second, two), 2);
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(result + x), _mm_packus_epi16(first, second));
+        }
+#endif
+
+        for (; x < pairs; ++x) { result[x] = average(top[2 * x], top[2 * x + 1], bottom[2 * x], bottom[2 * x + 1]); }
+        for (; x < width; ++x) { result[x] = average(top[2 * x], top[2 * x], bottom[2 * x], bottom[2 * x]); }
+    }
+
+    /*  Вспомогательный метод, который переводит строку из файла (по 3 байта на пиксель: синий, зеленый, красный)
+        в строку пикселей.  */
+    static void decodeRow(const uint8_t* bytes, int width, uint32_t* row)
+    {
+        for (int x = 0; x < width; ++x) { row[x] = (bytes[3 * x] << 16) | (bytes[3 * x + 1] << 8) | bytes[3 * x + 2]; }
+    }
+
+    /*  Вспомогательный метод, который переводит строку пикселей в байты для записи в файл (обратно к decodeRow).
+
+         nothing      blue        green        red
+        0000_0000 ' 0000_0000 ' 0000_0000 ' 0000_0000  */
+    static void encodeRow(const uint32_t* row, int width, uint8_t* bytes)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            bytes[3 * x]     = (row[x] >> 16) & 0xFF;
+            bytes[3 * x + 1] = (row[x] >> 8) & 0xFF;
+            bytes[3 * x + 2] = row[x] & 0xFF;
+        }
+    }
+
+    /*  Вспомогательный метод, который раскладывает строку из файла (по 3 байта на пиксель: синий, зеленый, красный)
+        по трем плоскостям, то есть переводит ее сразу в планарный вид (см. PlanarImage).  */
+    static void decodePlanarRow(const uint8_t* bytes, int width, uint8_t* blue, uint8_t* green, uint8_t* red)
+    {
+        for (int x = 0; x < width; ++x)
         {
-            pixels[i][i] = color;
-            pixels[i][info_block.width - i - 1] = color;
+            blue[x]  = bytes[3 * x];
+            green[x] = bytes[3 * x + 1];
+            red[x]   = bytes[3 * x + 2];
         }
     }
 
-    // Метод, позволяющий сохранить изображение в некоторый файл.
-    void save(const std::string& file_path)
+    // Вспомогательный метод, обратный decodePlanarRow: собирает байты строки файла из трех плоскостей.
+    static void encodePlanarRow(const uint8_t* blue, const uint8_t* green, const uint8_t* red, int width, uint8_t* bytes)
     {
-        // 1. Создаю выходной поток для записи в некоторый файл.
-        std::ofstream out_file(file_path, std::ios::out | std::ios::trunc);
+        for (int x = 0; x < width; ++x)
+        {
+            bytes[3 * x]     = blue[x];
+            bytes[3 * x + 1] = green[x];
+            bytes[3 * x + 2] = red[x];
+        }
+    }
 
-        // 2. Выравниваю строку по 4 байта.
-        int32_t row_stride = ((info_block.width * info_block.color_depth_in_bits + 31) / 32) * 4;
+    /*  Вспомогательный метод, который раскладывает count пикселей строки по плоскостям blue, green, red.
+        В SSE2-версии канал 16 пикселей выделяется маской и сдвигом и упаковывается в 16 байт.  */
+    static void splitRow(const uint32_t* row, int count, uint8_t* blue, uint8_t* green, uint8_t* red)
+    {
+        int x = 0;
 
-        // 3. Записываю в файл информацию о первых двух блоках.
-        out_file.write(reinterpret_cast<char*>(&file_header), sizeof(BMPFileHeader));
-        out_file.write(reinterpret_cast<char*>(&info_block), sizeof(BMPFileInfoBlock));
+#if defined(__SSE2__)
+        const __m128i mask = _mm_set1_epi32(0xFF);
 
-        // 4. В BMP-файле строки располагаются в обратном порядке (снизу вверх).
-        for (int y = info_block.height - 1; y >= 0; --y) 
+        for (; x + 16 <= count; x += 16)
         {
-            // 4.1 Создаю вектор, который будет содержать все байты некоторой строки.
-            std::vector<uint8_t> row_data;
+            __m128i part[4];
+            for (int j = 0; j < 4; ++j) { part[j] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x + 4 * j)); }
 
-            for (int x = 0; x < info_block.width; ++x) 
+            auto channel = [&](int shift)
             {
-                /* 4.2  Обрабатываю каждый пиксель, и в зависимости от его цвета
-                        отправляю в row_data соответствующую последовательность байтов.  */ 
-                uint8_t blue = 0, green = 0, red = 0;
+                __m128i value[4];
+                for (int j = 0; j < 4; ++j) { value[j] = _mm_and_si128(_mm_srli_epi32(part[j], shift), mask); }
+                return _mm_packus_epi16(_mm_packs_epi32(value[0], value[1]), _mm_packs_epi32(value[2], value[3]));
+            };
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(red + x), channel(0));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(green + x), channel(8));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(blue + x), channel(16));
+        }
+#endif
+
+        for (; x < count; ++x)
+        {
+            red[x]   = row[x] & 0xFF;
+            green[x] = (row[x] >> 8) & 0xFF;
+            blue[x]  = (row[x] >> 16) & 0xFF;
+        }
+    }
+
+    /*  Вспомогательный метод, обратный splitRow: собирает count пикселей строки из плоскостей blue, green, red.
+        В SSE2-версии байты красного и зеленого каналов чередуются (_mm_unpacklo_epi8), а затем чередуются
+        16-битные пары "красный, зеленый" и "синий, 0" - получаются готовые пиксели.  */
+    static void mergeRow(const uint8_t* blue, const uint8_t* green, const uint8_t* red, int count, uint32_t* row)
+    {
+        int x = 0;
+
+#if defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
 
-                /*  Избегаю потери качества при сохранении изображения!
+        for (; x + 16 <= count; x += 16)
+        {
+            __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(red + x));
+            __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i*>(green + x));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(blue + x));
 
-                     nothing      blue        green        red
-                    0000_0000 ' 0000_0000 ' 0000_0000 ' 0000_0000  */
-                blue    = (pixels[y][x] & (255 << 16)) >> 16;
-                green   = (pixels[y][x] & (255 << 8)) >> 8;
-                red     = (pixels[y][x] & (255));
+            __m128i red_green[2] = { _mm_unpacklo_epi8(r, g), _mm_unpackhi_epi8(r, g) };
+            __m128i blue_zero[2] = { _mm_unpacklo_epi8(b, zero), _mm_unpackhi_epi8(b, zero) };
 
-                // 4.3 Добавляю байты в ряд выходного файла (в правильной последовательности!).
-                row_data.push_back(blue);
-                row_data.push_back(green);
-                row_data.push_back(red);
+            for (int j = 0; j < 2; ++j)
+            {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(row + x + 8 * j), _mm_unpacklo_epi16(red_green[j], blue_zero[j]));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(row + x + 8 * j + 4), _mm_unpackhi_epi16(red_green[j], blue_zero[j]));
             }
+        }
+#endif
+
+        for (; x < count; ++x) { row[x] = (blue[x] << 16) | (green[x] << 8) | red[x]; }
+    }
+
+    /*  Вспомогательный метод, который смешивает пиксели a и b с весом fraction (0..255) для пикселя b.
+        Каналы обрабатываются "по два в одном числе": синий с красным и зеленый (с неиспользуемым байтом),
+        произведения 8-битного значения на 8-битный вес помещаются в 16-битные половины без переполнения.  */
+    static uint32_t lerpColors(uint32_t a, uint32_t b, uint32_t fraction)
+    {
+        const uint32_t mask = 0x00FF'00FF;
+        uint32_t inverse = 256 - fraction;
+
+        uint32_t blue_red = (((a & mask) * inverse + (b & mask) * fraction + 0x0080'0080) >> 8) & mask;
+        uint32_t green    = (((a >> 8) & mask) * inverse + ((b >> 8) & mask) * fraction + 0x0080'0080) & ~mask;
+
+        return blue_red | green;
+    }
+
+    /*  Вспомогательный метод, который возвращает яркость пикселя (0..255) по формуле ITU-R BT.601
+        Y = 0.299 * R + 0.587 * G + 0.114 * B в целых числах (веса умножены на 256, их сумма равна 256).  */
+    static uint32_t luminance(uint32_t color)
+    {
+        return (77 * (color & 0xFF) + 150 * ((color >> 8) & 0xFF) + 29 * ((color >> 16) & 0xFF) + 128) >> 8;
+    }
+
+    /*  Вспомогательный метод (SIMD-ядро яркости): записывает в result яркость (см. luminance) каждого из count
+        пикселей строки. В SSE2-версии каналы распаковываются в 16 бит, _mm_madd_epi16 дает для каждого пикселя
+        две частичные суммы 77 * R + 150 * G и 29 * B, которые затем складываются, сдвигаются и упаковываются
+        в байты - результат в точности совпадает с luminance.  */
+    static void lumaRow(const uint32_t* row, int count, uint8_t* result)
+    {
+        int x = 0;
+
+#if defined(__SSE2__)
+        const __m128i zero     = _mm_setzero_si128();
+        const __m128i weights  = _mm_setr_epi16(77, 150, 29, 0, 77, 150, 29, 0);
+        const __m128i rounding = _mm_set1_epi32(128);
+
+        // Яркости 4 пикселей (в 32-битных числах).
+        auto luma4 = [&](const uint32_t* source)
+        {
+            __m128i value  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source));
+            __m128i first  = _mm_madd_epi16(_mm_unpacklo_epi8(value, zero), weights);
+            __m128i second = _mm_madd_epi16(_mm_unpackhi_epi8(value, zero), weights);
+
+            // first = [a0, b0, a1, b1], second = [a2, b2, a3, b3] -> [a0 + b0, a1 + b1, a2 + b2, a3 + b3].
+            __m128i even = _mm_unpacklo_epi32(first, second);
+            __m128i odd  = _mm_unpackhi_epi32(first, second);
+            even = _mm_add_epi32(even, _mm_srli_si128(even, 8));
+            odd  = _mm_add_epi32(odd, _mm_srli_si128(odd, 8));
+
+            return _mm_srli_epi32(_mm_add_epi32(_mm_unpacklo_epi32(even, odd), rounding), 8);
+        };
+
+        for (; x + 16 <= count; x += 16)
+        {
+            __m128i low  = _mm_packs_epi32(luma4(row + x), luma4(row + x + 4));
+            __m128i high = _mm_packs_epi32(luma4(row + x + 8), luma4(row + x + 12));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(result + x), _mm_packus_epi16(low, high));
+        }
+#endif
+
+        for (; x < count; ++x) { result[x] = static_cast<uint8_t>(luminance(row[x])); }
+    }
+
+    /*  Вспомогательный метод (SIMD-ядро градиента): по трем соседним строкам яркости above, row, below считает
+        для count пикселей производные gx (слева направо), gy (сверху вниз) и L1-модуль градиента |gx| + |gy|.
+        Ядро 3x3 задается весами side и center: 1 и 2 для оператора Собеля, 3 и 10 для оператора Шарра.
+        Строки должны быть дополнены одним пикселем слева и справа (row[-1] и row[count] доступны).
+        В SSE2-версии 8 пикселей обрабатываются в 16-битных числах за один проход по трем строкам.  */
+    static void gradientRow(const uint8_t* above, const uint8_t* row, const uint8_t* below, int count, int side, int center,
+                            int16_t* gx, int16_t* gy, int16_t* magnitude)
+    {
+        int x = 0;
+
+#if defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i side_weight   = _mm_set1_epi16(static_cast<int16_t>(side));
+        const __m128i center_weight = _mm_set1_epi16(static_cast<int16_t>(center));
+
+        auto load = [&](const uint8_t* source) { return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(source)), zero); };
+        auto absolute = [&](__m128i value) { return _mm_max_epi16(value, _mm_sub_epi16(zero, value)); };
+
+        for (; x + 8 <= count; x += 8)
+        {
+            __m128i above_left = load(above + x - 1), above_center = load(above + x), above_right = load(above + x + 1);
+            __m128i row_left   = load(row + x - 1),                                   row_right   = load(row + x + 1);
+            __m128i below_left = load(below + x - 1), below_center = load(below + x), below_right = load(below + x + 1);
 
-            // 5. При необходимости, добавляю отступ (padding) для выравнивания строки по 4 байта.
-            while (row_data.size() < static_cast<size_t>(row_stride)) {
-                row_data.push_back(0);
+            __m128i dx = _mm_add_epi16(_mm_mullo_epi16(_mm_add_epi16(_mm_sub_epi16(above_right, above_left), _mm_sub_epi16(below_right, below_left)), side_weight),
+                                       _mm_mullo_epi16(_mm_sub_epi16(row_right, row_left), center_weight));
+            __m128i dy = _mm_add_epi16(_mm_mullo_epi16(_mm_add_epi16(_mm_sub_epi16(below_left, above_left), _mm_sub_epi16(below_right, above_right)), side_weight),
+                                       _mm_mullo_epi16(_mm_sub_epi16(below_center, above_center), center_weight));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(gx + x), dx);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(gy + x), dy);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(magnitude + x), _mm_add_epi16(absolute(dx), absolute(dy)));
+        }
+#endif
+
+        for (; x < count; ++x)
+        {
+            int dx = side * (above[x + 1] - above[x - 1] + below[x + 1] - below[x - 1]) + center * (row[x + 1] - row[x - 1]);
+            int dy = side * (below[x - 1] - above[x - 1] + below[x + 1] - above[x + 1]) + center * (below[x] - above[x]);
+
+            gx[x] = static_cast<int16_t>(dx);
+            gy[x] = static_cast<int16_t>(dy);
+            magnitude[x] = static_cast<int16_t>(std::abs(dx) + std::abs(dy));
+        }
+    }
+
+    /*  Вспомогательный метод (SIMD-ядро бинаризации): упаковывает count байтов яркости luma в биты bits
+        (бит равен 1, если яркость больше level; старший бит байта - левый пиксель, как в 1-битном BMP).
+        В SSE2-версии 16 байтов сравниваются сразу (беззнаковое сравнение - через сдвиг диапазона на 128),
+        _mm_movemask_epi8 собирает результаты в 16 бит, а порядок битов в каждом байте разворачивается по таблице.  */
+    static void thresholdRow(const uint8_t* luma, int count, uint8_t level, uint8_t* bits)
+    {
+        int x = 0;
+
+#if defined(__SSE2__)
+        static const std::array<uint8_t, 256> reversed = []
+        {
+            std::array<uint8_t, 256> result{};
+            for (int value = 0; value < 256; ++value) {
+                for (int bit = 0; bit < 8; ++bit) { result[value] |= ((value >> bit) & 1) << (7 - bit); }
             }
+            return result;
+        }();
 
-            // 6. Записываю полученную строку в выходной файл.
-            out_file.write(reinterpret_cast<char*>(row_data.data()), row_data.size());
+        const __m128i bias  = _mm_set1_epi8(static_cast<char>(0x80));
+        const __m128i limit = _mm_set1_epi8(static_cast<char>(level ^ 0x80));
+
+        for (; x + 16 <= count; x += 16)
+        {
+            __m128i value = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(luma + x)), bias);
+            int mask = _mm_movemask_epi8(_mm_cmpgt_epi8(value, limit));
+
+            bits[x / 8]     = reversed[mask & 0xFF];
+            bits[x / 8 + 1] = reversed[mask >> 8];
         }
+#endif
 
-        // 7. Закрываю выходной поток.
-        out_file.close();
+        for (; x < count; x += 8)
+        {
+            uint8_t byte = 0;
+            for (int bit = 0; bit < 8 && x + bit < count; ++bit) { byte |= (luma[x + bit] > level) << (7 - bit); }
+            bits[x / 8] = byte;
+        }
     }
 
-    // Метод, позволяющий вывести изображение в консоль.
-    void printImage() const
+    /*  Вспомогательный метод, который строит сеть сравнений, выбирающую медиану count элементов (count <= 32):
+        после выполнения всех пар (a, b) из результата (в a - меньшее, в b - большее значение) элемент count / 2
+        равен медиане. Берется сортирующая сеть Батчера (odd-even merge sort) на 32 входа; сравнения с входами
+        за пределами count отбрасываются (такие входы можно считать бесконечно большими, и сравнения с ними
+        ничего не меняют), а затем - сравнения, от которых средний элемент не зависит (просмотром с конца).
+        Для 9 элементов остается 32 сравнения, для 25 - 113.  */
+    static std::vector<std::pair<int, int>> medianNetwork(int count)
     {
-        for (int y = 0; y < info_block.height; ++y)
+        const int inputs = 32;
+        std::vector<std::pair<int, int>> pairs;
+
+        for (int p = 1; p < inputs; p *= 2) {
+            for (int k = p; k >= 1; k /= 2) {
+                for (int j = k % p; j + k < inputs; j += 2 * k) {
+                    for (int i = 0; i < k && i + j + k < inputs; ++i)
+                    {
+                        if ((i + j) / (2 * p) == (i + j + k) / (2 * p) && i + j + k < count) { pairs.emplace_back(i + j, i + j + k); }
+                    }
+                }
+            }
+        }
+
+        std::vector<std::pair<int, int>> result;
+        std::vector<bool> needed(count, false);
+        needed[count / 2] = true;
+
+        for (auto pair = pairs.rbegin(); pair != pairs.rend(); ++pair)
         {
-            for (int x = 0; x < info_block.width; ++x)
+            if (needed[pair->first] || needed[pair->second])
             {
-                // Если пиксель черный:
-                if (pixels[y][x] == 0x00'00'00) { std::cout << black; }
+                result.push_back(*pair);
+                needed[pair->first] = needed[pair->second] = true;
+            }
+        }
 
-                // Если пиксель белый:
-                else if (pixels[y][x] == 0xFF'FF'FF) { std::cout << white; }
+        std::reverse(result.begin(), result.end());
+        return result;
+    }
 
-                // Если пиксель неизвестного мне цвета:
-                else { std::cout << unknown_color; }
+    /*  Элементарные операции над числами с плавающей точкой для ядер цветовых пространств: ScalarLanes
+        работает с одним значением, VectorLanes (SSE2) - сразу с четырьмя. Каждое ядро пишется один раз
+        как шаблон и вызывается методом forEachLane: с VectorLanes по 4 пикселя, а с ScalarLanes - для хвоста строки.  */
+    struct ScalarLanes
+    {
+        using Value = float;
+        using Mask  = bool;
+
+        static Value load(const float* source) { return *source; }
+        static void store(float* destination, Value value) { *destination = value; }
+        static Value set(float value) { return value; }
+
+        static Value add(Value a, Value b) { return a + b; }
+        static Value sub(Value a, Value b) { return a - b; }
+        static Value mul(Value a, Value b) { return a * b; }
+        static Value div(Value a, Value b) { return a / b; }
+        static Value min(Value a, Value b) { return std::min(a, b); }
+        static Value max(Value a, Value b) { return std::max(a, b); }
+        static Value abs(Value a) { return std::fabs(a); }
+        static Value floor(Value a) { return std::floor(a); }
+        static Value cbrt(Value a) { return std::cbrt(a); }
+
+        static Mask less(Value a, Value b) { return a < b; }
+        static Mask equal(Value a, Value b) { return a == b; }
+        static Value select(Mask mask, Value a, Value b) { return mask ? a : b; }
+    };
+
+#if defined(__SSE2__)
+    struct VectorLanes
+    {
+        using Value = __m128;
+        using Mask  = __m128;
+
+        static Value load(const float* source) { return _mm_loadu_ps(source); }
+        static void store(float* destination, Value value) { _mm_storeu_ps(destination, value); }
+        static Value set(float value) { return _mm_set1_ps(value); }
+
+        static Value add(Value a, Value b) { return _mm_add_ps(a, b); }
+        static Value sub(Value a, Value b) { return _mm_sub_ps(a, b); }
+        static Value mul(Value a, Value b) { return _mm_mul_ps(a, b); }
+        static Value div(Value a, Value b) { return _mm_div_ps(a, b); }
+        static Value min(Value a, Value b) { return _mm_min_ps(a, b); }
+        static Value max(Value a, Value b) { return _mm_max_ps(a, b); }
+        static Value abs(Value a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+
+        // Округление вниз для |a| < 2^31: отбрасывание дробной части и поправка на 1 для отрицательных чисел.
+        static Value floor(Value a)
+        {
+            __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+            return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmplt_ps(a, truncated), _mm_set1_ps(1.0f)));
+        }
+
+        /*  Кубический корень неотрицательного числа: начальное приближение получается делением двоичного
+            представления на 3 (то есть делением порядка), затем три итерации Ньютона y = (2y + a / y^2) / 3.  */
+        static Value cbrt(Value a)
+        {
+            __m128i bits  = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_castps_si128(a)), _mm_set1_ps(1.0f / 3.0f)));
+            __m128 result = _mm_castsi128_ps(_mm_add_epi32(bits, _mm_set1_epi32(0x2A51'4067)));
+
+            for (int iteration = 0; iteration < 3; ++iteration) {
+                result = _mm_mul_ps(_mm_add_ps(_mm_add_ps(result, result), _mm_div_ps(a, _mm_mul_ps(result, result))), _mm_set1_ps(1.0f / 3.0f));
             }
 
-            std::cout << '\n';
+            return result;
+        }
+
+        static Mask less(Value a, Value b) { return _mm_cmplt_ps(a, b); }
+        static Mask equal(Value a, Value b) { return _mm_cmpeq_ps(a, b); }
+        static Value select(Mask mask, Value a, Value b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+    };
+#endif
+
+    // Вспомогательный метод, который вызывает kernel(lanes, i) для всех i из [0, count): по 4 элемента в SSE2-версии, затем по одному.
+    template <typename Kernel>
+    static void forEachLane(int count, const Kernel& kernel)
+    {
+        int i = 0;
+
+#if defined(__SSE2__)
+        for (; i + 4 <= count; i += 4) { kernel(VectorLanes(), i); }
+#endif
+
+        for (; i < count; ++i) { kernel(ScalarLanes(), i); }
+    }
+
+    /*  Вспомогательный метод, который возвращает цветовой тон (0..360 градусов) по каналам r, g, b, их максимуму
+        и размаху delta = max - min. Для серых пикселей (delta = 0) тон равен 0.  */
+    template <typename L>
+    static typename L::Value hueOf(typename L::Value r, typename L::Value g, typename L::Value b,
+                                   typename L::Value maximum, typename L::Value delta)
+    {
+        typename L::Mask colored = L::less(L::set(0.0f), delta);
+        typename L::Value scale  = L::div(L::set(60.0f), L::select(colored, delta, L::set(1.0f)));
+
+        typename L::Value from_red   = L::mul(L::sub(g, b), scale);
+        typename L::Value from_green = L::add(L::mul(L::sub(b, r), scale), L::set(120.0f));
+        typename L::Value from_blue  = L::add(L::mul(L::sub(r, g), scale), L::set(240.0f));
+
+        typename L::Value hue = L::select(L::equal(maximum, r), from_red, L::select(L::equal(maximum, g), from_green, from_blue));
+        hue = L::select(L::less(hue, L::set(0.0f)), L::add(hue, L::set(360.0f)), hue);
+
+        return L::select(colored, hue, L::set(0.0f));
+    }
+
+    // Вспомогательный метод, который возвращает x mod period (в диапазоне [0, period)).
+    template <typename L>
+    static typename L::Value wrap(typename L::Value x, float period)
+    {
+        return L::sub(x, L::mul(L::floor(L::mul(x, L::set(1.0f / period))), L::set(period)));
+    }
+
+    /*  Ядра цветовых пространств. Каждое ядро преобразует на месте элемент i (или 4 элемента, начиная с i)
+        трех плоскостей: прямые ядра (rgbTo...) получают каналы R, G, B (0..255, для Lab - линейные 0..1)
+        и записывают компоненты пространства, обратные (...ToRgb) - наоборот. Обратные ядра не ограничивают
+        результат диапазоном, это делается при упаковке в пиксели (см. packColorRow).  */
+    template <typename L>
+    static void rgbToHsv(float* first, float* second, float* third, int i)
+    {
+        typename L::Value r = L::load(first + i), g = L::load(second + i), b = L::load(third + i);
+        typename L::Value maximum = L::max(r, L::max(g, b));
+        typename L::Value delta   = L::sub(maximum, L::min(r, L::min(g, b)));
+
+        L::store(first + i, hueOf<L>(r, g, b, maximum, delta));
+        L::store(second + i, L::div(delta, L::max(maximum, L::set(1e-6f))));
+        L::store(third + i, L::mul(maximum, L::set(1.0f / 255.0f)));
+    }
+
+    // Канал n (5 - R, 3 - G, 1 - B) по тону, насыщенности и значению: V - V * S * clamp(min(k, 4 - k), 0, 1), k = (n + H / 60) mod 6.
+    template <typename L>
+    static void hsvToRgb(float* first, float* second, float* third, int i)
+    {
+        typename L::Value sector = L::mul(L::load(first + i), L::set(1.0f / 60.0f));
+        typename L::Value value  = L::mul(L::load(third + i), L::set(255.0f));
+        typename L::Value chroma = L::mul(value, L::load(second + i));
+
+        auto channel = [&](float n)
+        {
+            typename L::Value k = wrap<L>(L::add(sector, L::set(n)), 6.0f);
+            typename L::Value ramp = L::max(L::min(L::min(k, L::sub(L::set(4.0f), k)), L::set(1.0f)), L::set(0.0f));
+            return L::sub(value, L::mul(chroma, ramp));
+        };
+
+        L::store(first + i, channel(5.0f));
+        L::store(second + i, channel(3.0f));
+        L::store(third + i, channel(1.0f));
+    }
+
+    template <typename L>
+    static void rgbToHsl(float* first, float* second, float* third, int i)
+    {
+        typename L::Value r = L::load(first + i), g = L::load(second + i), b = L::load(third + i);
+        typename L::Value maximum = L::max(r, L::max(g, b));
+        typename L::Value minimum = L::min(r, L::min(g, b));
+        typename L::Value delta   = L::sub(maximum, minimum);
+        typename L::Value sum     = L::add(maximum, minimum);
+
+        // S = delta / (255 - |max + min - 255|), для серых пикселей числитель равен 0.
+        typename L::Value range = L::sub(L::set(255.0f), L::abs(L::sub(sum, L::set(255.0f))));
+
+        L::store(first + i, hueOf<L>(r, g, b, maximum, delta));
+        L::store(second + i, L::div(delta, L::max(range, L::set(1e-6f))));
+        L::store(third + i, L::mul(sum, L::set(1.0f / 510.0f)));
+    }
+
+    // Канал n (0 - R, 8 - G, 4 - B): L - a * clamp(min(k - 3, 9 - k), -1, 1), k = (n + H / 30) mod 12, a = S * min(L, 1 - L).
+    template <typename L>
+    static void hslToRgb(float* first, float* second, float* third, int i)
+    {
+        typename L::Value sector    = L::mul(L::load(first + i), L::set(1.0f / 30.0f));
+        typename L::Value lightness = L::load(third + i);
+        typename L::Value amplitude = L::mul(L::load(second + i), L::min(lightness, L::sub(L::set(1.0f), lightness)));
+
+        auto channel = [&](float n)
+        {
+            typename L::Value k = wrap<L>(L::add(sector, L::set(n)), 12.0f);
+            typename L::Value ramp = L::max(L::min(L::min(L::sub(k, L::set(3.0f)), L::sub(L::set(9.0f), k)), L::set(1.0f)), L::set(-1.0f));
+            return L::mul(L::sub(lightness, L::mul(amplitude, ramp)), L::set(255.0f));
+        };
+
+        L::store(first + i, channel(0.0f));
+        L::store(second + i, channel(8.0f));
+        L::store(third + i, channel(4.0f));
+    }
+
+    // Полнодиапазонный YCbCr (как в JPEG, ITU-R BT.601): Y, Cb, Cr в диапазоне 0..255, нейтральные Cb и Cr равны 128.
+    template <typename L>
+    static void rgbToYCbCr(float* first, float* second, float* third, int i)
+    {
+        typename L::Value r = L::load(first + i), g = L::load(second + i), b = L::load(third + i);
+
+        auto combine = [&](float wr, float wg, float wb, float offset) {
+            return L::add(L::add(L::mul(r, L::set(wr)), L::mul(g, L::set(wg))), L::add(L::mul(b, L::set(wb)), L::set(offset)));
+        };
+
+        L::store(first + i, combine(0.299f, 0.587f, 0.114f, 0.0f));
+        L::store(second + i, combine(-0.168736f, -0.331264f, 0.5f, 128.0f));
+        L::store(third + i, combine(0.5f, -0.418688f, -0.081312f, 128.0f));
+    }
+
+    template <typename L>
+    static void yCbCrToRgb(float* first, float* second, float* third, int i)
+    {
+        typename L::Value y  = L::load(first + i);
+        typename L::Value cb = L::sub(L::load(second + i), L::set(128.0f));
+        typename L::Value cr = L::sub(L::load(third + i), L::set(128.0f));
+
+        L::store(first + i, L::add(y, L::mul(cr, L::set(1.402f))));
+        L::store(second + i, L::sub(y, L::add(L::mul(cb, L::set(0.344136f)), L::mul(cr, L::set(0.714136f)))));
+        L::store(third + i, L::add(y, L::mul(cb, L::set(1.772f))));
+    }
+
+    /*  CIE L*a*b* с белой точкой D65: линейные R, G, B (0..1) переводятся в XYZ, нормируются на белую точку,
+        и f(t) = t^(1/3) при t > (6/29)^3, иначе t * (29/6)^2 / 3 + 4/29. L* лежит в диапазоне 0..100, a* и b* - примерно -128..127.  */
+    template <typename L>
+    static void rgbToLab(float* first, float* second, float* third, int i)
+    {
+        typename L::Value r = L::load(first + i), g = L::load(second + i), b = L::load(third + i);
+
+        auto f = [&](float wr, float wg, float wb)
+        {
+            typename L::Value t = L::add(L::add(L::mul(r, L::set(wr)), L::mul(g, L::set(wg))), L::mul(b, L::set(wb)));
+            typename L::Value linear = L::add(L::mul(t, L::set(841.0f / 108.0f)), L::set(4.0f / 29.0f));
+            return L::select(L::less(L::set(216.0f / 24389.0f), t), L::cbrt(t), linear);
+        };
+
+        // Строки матрицы sRGB -> XYZ, уже поделенные на координаты белой точки (0.95047, 1, 1.08883).
+        typename L::Value fx = f(0.4124564f / 0.95047f, 0.3575761f / 0.95047f, 0.1804375f / 0.95047f);
+        typename L::Value fy = f(0.2126729f, 0.7151522f, 0.0721750f);
+        typename L::Value fz = f(0.0193339f / 1.08883f, 0.1191920f / 1.08883f, 0.9503041f / 1.08883f);
+
+        L::store(first + i, L::sub(L::mul(fy, L::set(116.0f)), L::set(16.0f)));
+        L::store(second + i, L::mul(L::sub(fx, fy), L::set(500.0f)));
+        L::store(third + i, L::mul(L::sub(fy, fz), L::set(200.0f)));
+    }
+
+    template <typename L>
+    static void labToRgb(float* first, float* second, float* third, int i)
+    {
+        typename L::Value fy = L::mul(L::add(L::load(first + i), L::set(16.0f)), L::set(1.0f / 116.0f));
+        typename L::Value fx = L::add(fy, L::mul(L::load(second + i), L::set(1.0f / 500.0f)));
+        typename L::Value fz = L::sub(fy, L::mul(L::load(third + i), L::set(1.0f / 200.0f)));
+
+        auto inverse = [&](typename L::Value f, float white)
+        {
+            typename L::Value cube   = L::mul(L::mul(f, f), f);
+            typename L::Value linear = L::mul(L::sub(f, L::set(4.0f / 29.0f)), L::set(108.0f / 841.0f));
+            return L::mul(L::select(L::less(L::set(6.0f / 29.0f), f), cube, linear), L::set(white));
+        };
+
+        typename L::Value x = inverse(fx, 0.95047f), y = inverse(fy, 1.0f), z = inverse(fz, 1.08883f);
+
+        auto combine = [&](float wx, float wy, float wz) {
+            return L::add(L::add(L::mul(x, L::set(wx)), L::mul(y, L::set(wy))), L::mul(z, L::set(wz)));
+        };
+
+        L::store(first + i, combine(3.2404542f, -1.5371385f, -0.4985314f));
+        L::store(second + i, combine(-0.9692660f, 1.8760108f, 0.0415560f));
+        L::store(third + i, combine(0.0556434f, -0.2040259f, 1.0572252f));
+    }
+
+    /*  Таблицы гамма-кривой sRGB: to_linear - линейное значение (0..1) каждого 8-битного уровня; для отрезка
+        линейных значений [i / 4095, (i + 1) / 4095) from_linear[i] - уровень у его левого края, а next_bound[i] -
+        граница округления к следующему уровню. Наибольшая крутизна кривой - около 3300 уровней на единицу, то есть
+        меньше одного уровня на отрезок, поэтому точный уровень равен from_linear[i] + (value >= next_bound[i]).  */
+    struct SrgbTables
+    {
+        std::array<float, 256> to_linear;
+        std::array<uint8_t, 4096> from_linear;
+        std::array<float, 4096> next_bound;
+    };
+
+    // Вспомогательный метод, который один раз (при первом обращении) строит таблицы sRGB и возвращает их.
+    static const SrgbTables& srgbTables()
+    {
+        static const SrgbTables tables = []
+        {
+            auto decode = [](double v) { return v <= 0.04045 ? v / 12.92 : std::pow((v + 0.055) / 1.055, 2.4); };
+            auto encode = [](double v) { return v <= 0.0031308 ? v * 12.92 : 1.055 * std::pow(v, 1.0 / 2.4) - 0.055; };
+
+            SrgbTables result;
+            for (int level = 0; level < 256; ++level) { result.to_linear[level] = static_cast<float>(decode(level / 255.0)); }
+
+            // Левый край отрезка чуть сдвинут влево: так индекс остается верным и при ошибке округления в value * 4095.
+            for (int i = 0; i < 4096; ++i)
+            {
+                long level = std::lround(encode(std::max(0.0, (i - 0.01) / 4095.0)) * 255.0);
+                result.from_linear[i] = static_cast<uint8_t>(level);
+                result.next_bound[i]  = level < 255 ? static_cast<float>(decode((level + 0.5) / 255.0)) : std::numeric_limits<float>::infinity();
+            }
+
+            return result;
+        }();
+
+        return tables;
+    }
+
+    // Вспомогательный метод, который возвращает 8-битный уровень sRGB, ближайший к линейному значению value (без ветвлений).
+    static uint32_t encodeSrgb(const SrgbTables& tables, float value)
+    {
+        value = value > 0.0f ? std::min(value, 1.0f) : 0.0f;
+        int i = static_cast<int>(value * 4095.0f);
+
+        return tables.from_linear[i] + (value >= tables.next_bound[i]);
+    }
+
+    /*  Вспомогательный метод, который раскладывает count пикселей строки по трем плоскостям: red, green, blue (0..255).
+        При linear = true уровни переводятся по таблице sRGB в линейные значения 0..1 (для Lab).  */
+    static void unpackColorRow(const uint32_t* row, int count, bool linear, float* red, float* green, float* blue)
+    {
+        int x = 0;
+
+        if (linear)
+        {
+            const SrgbTables& tables = srgbTables();
+            for (; x < count; ++x)
+            {
+                red[x]   = tables.to_linear[row[x] & 0xFF];
+                green[x] = tables.to_linear[(row[x] >> 8) & 0xFF];
+                blue[x]  = tables.to_linear[(row[x] >> 16) & 0xFF];
+            }
+            return;
+        }
+
+#if defined(__SSE2__)
+        const __m128i mask = _mm_set1_epi32(0xFF);
+
+        for (; x + 4 <= count; x += 4)
+        {
+            __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+            _mm_storeu_ps(red + x, _mm_cvtepi32_ps(_mm_and_si128(value, mask)));
+            _mm_storeu_ps(green + x, _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(value, 8), mask)));
+            _mm_storeu_ps(blue + x, _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(value, 16), mask)));
+        }
+#endif
+
+        for (; x < count; ++x)
+        {
+            red[x]   = static_cast<float>(row[x] & 0xFF);
+            green[x] = static_cast<float>((row[x] >> 8) & 0xFF);
+            blue[x]  = static_cast<float>((row[x] >> 16) & 0xFF);
+        }
+    }
+
+    /*  Вспомогательный метод, обратный unpackColorRow: собирает count пикселей строки из трех плоскостей,
+        округляя значения и ограничивая их диапазоном 0..255 (при linear = true - через таблицы sRGB).
+        Оба пути округляют одинаково - половина вверх (x + 0.5 с отбрасыванием дробной части), а NaN дает 0,
+        так что результат не зависит ни от позиции пикселя в строке, ни от наличия SSE2.  */
+    static void packColorRow(const float* red, const float* green, const float* blue, int count, bool linear, uint32_t* row)
+    {
+        int x = 0;
+
+        if (linear)
+        {
+            const SrgbTables& tables = srgbTables();
+            for (; x < count; ++x) { row[x] = encodeSrgb(tables, red[x]) | (encodeSrgb(tables, green[x]) << 8) | (encodeSrgb(tables, blue[x]) << 16); }
+            return;
+        }
+
+#if defined(__SSE2__)
+        const __m128 low  = _mm_setzero_ps();
+        const __m128 high = _mm_set1_ps(255.0f);
+        const __m128 half = _mm_set1_ps(0.5f);
+
+        // _mm_cvtps_epi32 округлял бы половины к четному - поэтому прибавляю 0.5 и отбрасываю дробную часть.
+        auto level = [&](const float* source) { return _mm_cvttps_epi32(_mm_add_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(source), low), high), half)); };
+
+        for (; x + 4 <= count; x += 4)
+        {
+            __m128i value = _mm_or_si128(level(red + x), _mm_or_si128(_mm_slli_epi32(level(green + x), 8), _mm_slli_epi32(level(blue + x), 16)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(row + x), value);
+        }
+#endif
+
+        auto round = [](float value) { return static_cast<uint32_t>(std::min(std::max(0.0f, value), 255.0f) + 0.5f); };
+
+        for (; x < count; ++x) { row[x] = round(red[x]) | (round(green[x]) << 8) | (round(blue[x]) << 16); }
+    }
+
+    // Вспомогательный метод, который смешивает цвет color с пикселем (x, y) с непрозрачностью alpha (0..255).
+    void blendPixel(int x, int y, uint32_t color, uint32_t alpha)
+    {
+        pixels[y][x] = blendColors(pixels[y][x], color, alpha);
+    }
+
+    /*  Вспомогательный метод, который закрашивает горизонтальный отрезок [x_begin, x_end) строки y
+        цветом color с непрозрачностью alpha. Отрезок предварительно обрезается по границам изображения.
+        Непрозрачная заливка делается через std::fill_n -> компилятор превращает ее в широкие
+        (векторные) записи, а полупрозрачная - через SIMD-ядро blendSpan.  */
+    void fillSpan(int y, int x_begin, int x_end, uint32_t color, uint32_t alpha = 255)
+    {
+        if (y < 0 || y >= static_cast<int>(info_block.height) || alpha == 0) { return; }
+
+        x_begin = std::max(x_begin, 0);
+        x_end   = std::min(x_end, static_cast<int>(info_block.width));
+
+        if (x_begin >= x_end) { return; }
+
+        if (alpha == 255) { std::fill_n(pixels[y].data() + x_begin, x_end - x_begin, color); }
+        else              { blendSpan(pixels[y].data() + x_begin, nullptr, color, x_end - x_begin, alpha); }
+    }
+
+    /*  Описание встроенного моноширинного растрового шрифта 5x7 (символы ASCII с 32 по 126).
+        Каждый символ занимает ячейку 6x8 пикселей (5x7 + по одному пикселю на интервалы).  */
+    static const int glyph_width   = 5;
+    static const int glyph_height  = 7;
+    static const int glyph_advance = 6;
+    static const int line_advance  = 8;
+    static const int glyph_count   = 95;
+
+    /*  Атлас глифов: каждая строка каждого глифа заранее разложена на непрерывные отрезки (span)
+        закрашенных пикселей. Тогда вывод глифа - это всего несколько заливок отрезков на строку,
+        без проверки каждого бита. Отрезки строки r глифа g лежат в runs
+        в диапазоне [row_offsets[g * glyph_height + r], row_offsets[g * glyph_height + r + 1]).  */
+    struct GlyphAtlas
+    {
+        struct Run
+        {
+            uint8_t start;
+            uint8_t length;
+        };
+
+        std::vector<Run> runs;
+        std::vector<uint16_t> row_offsets;
+    };
+
+    // Вспомогательный метод, который один раз (при первом обращении) строит атлас глифов и возвращает его.
+    static const GlyphAtlas& glyphAtlas()
+    {
+        /*  Растровый шрифт: по 5 байт на символ, каждый байт - столбец глифа
+            (младший бит - верхняя строка, 7-й бит не используется).  */
+        static const uint8_t font[glyph_count * glyph_width] =
+        {
+            0x00,0x00,0x00,0x00,0x00, 0x00,0x00,0x5F,0x00,0x00, 0x00,0x07,0x00,0x07,0x00, 0x14,0x7F,0x14,0x7F,0x14,
+            0x24,0x2A,0x7F,0x2A,0x12, 0x23,0x13,0x08,0x64,0x62, 0x36,0x49,0x55,0x22,0x50, 0x00,0x05,0x03,0x00,0x00,
+            0x00,0x1C,0x22,0x41,0x00, 0x00,0x41,0x22,0x1C,0x00, 0x08,0x2A,0x1C,0x2A,0x08, 0x08,0x08,0x3E,0x08,0x08,
+            0x00,0x50,0x30,0x00,0x00, 0x08,0x08,0x08,0x08,0x08, 0x00,0x60,0x60,0x00,0x00, 0x20,0x10,0x08,0x04,0x02,
+            0x3E,0x51,0x49,0x45,0x3E, 0x00,0x42,0x7F,0x40,0x00, 0x42,0x61,0x51,0x49,0x46, 0x21,0x41,0x45,0x4B,0x31,
+            0x18,0x14,0x12,0x7F,0x10, 0x27,0x45,0x45,0x45,0x39, 0x3C,0x4A,0x49,0x49,0x30, 0x01,0x71,0x09,0x05,0x03,
+            0x36,0x49,0x49,0x49,0x36, 0x06,0x49,0x49,0x29,0x1E, 0x00,0x36,0x36,0x00,0x00, 0x00,0x56,0x36,0x00,0x00,
+            0x08,0x14,0x22,0x41,0x00, 0x14,0x14,0x14,0x14,0x14, 0x00,0x41,0x22,0x14,0x08, 0x02,0x01,0x51,0x09,0x06,
+            0x32,0x49,0x79,0x41,0x3E, 0x7E,0x11,0x11,0x11,0x7E, 0x7F,0x49,0x49,0x49,0x36, 0x3E,0x41,0x41,0x41,0x22,
+            0x7F,0x41,0x41,0x22,0x1C, 0x7F,0x49,0x49,0x49,0x41, 0x7F,0x09,0x09,0x09,0x01, 0x3E,0x41,0x49,0x49,0x7A,
+            0x7F,0x08,0x08,0x08,0x7F, 0x00,0x41,0x7F,0x41,0x00, 0x20,0x40,0x41,0x3F,0x01, 0x7F,0x08,0x14,0x22,0x41,
+            0x7F,0x40,0x40,0x40,0x40, 0x7F,0x02,0x0C,0x02,0x7F, 0x7F,0x04,0x08,0x10,0x7F, 0x3E,0x41,0x41,0x41,0x3E,
+            0x7F,0x09,0x09,0x09,0x06, 0x3E,0x41,0x51,0x21,0x5E, 0x7F,0x09,0x19,0x29,0x46, 0x46,0x49,0x49,0x49,0x31,
+            0x01,0x01,0x7F,0x01,0x01, 0x3F,0x40,0x40,0x40,0x3F, 0x1F,0x20,0x40,0x20,0x1F, 0x3F,0x40,0x38,0x40,0x3F,
+            0x63,0x14,0x08,0x14,0x63, 0x07,0x08,0x70,0x08,0x07, 0x61,0x51,0x49,0x45,0x43, 0x00,0x7F,0x41,0x41,0x00,
+            0x02,0x04,0x08,0x10,0x20, 0x00,0x41,0x41,0x7F,0x00, 0x04,0x02,0x01,0x02,0x04, 0x40,0x40,0x40,0x40,0x40,
+            0x00,0x01,0x02,0x04,0x00, 0x20,0x54,0x54,0x54,0x78, 0x7F,0x48,0x44,0x44,0x38, 0x38,0x44,0x44,0x44,0x20,
+            0x38,0x44,0x44,0x48,0x7F, 0x38,0x54,0x54,0x54,0x18, 0x08,0x7E,0x09,0x01,0x02, 0x0C,0x52,0x52,0x52,0x3E,
+            0x7F,0x08,0x04,0x04,0x78, 0x00,0x44,0x7D,0x40,0x00, 0x20,0x40,0x44,0x3D,0x00, 0x7F,0x10,0x28,0x44,0x00,
+            0x00,0x41,0x7F,0x40,0x00, 0x7C,0x04,0x18,0x04,0x78, 0x7C,0x08,0x04,0x04,0x78, 0x38,0x44,0x44,0x44,0x38,
+            0x7C,0x14,0x14,0x14,0x08, 0x08,0x14,0x14,0x18,0x7C, 0x7C,0x08,0x04,0x04,0x08, 0x48,0x54,0x54,0x54,0x20,
+            0x04,0x3F,0x44,0x40,0x20, 0x3C,0x40,0x40,0x20,0x7C, 0x1C,0x20,0x40,0x20,0x1C, 0x3C,0x40,0x30,0x40,0x3C,
+            0x44,0x28,0x10,0x28,0x44, 0x0C,0x50,0x50,0x50,0x3C, 0x44,0x64,0x54,0x4C,0x44, 0x00,0x08,0x36,0x41,0x00,
+            0x00,0x00,0x7F,0x00,0x00, 0x00,0x41,0x36,0x08,0x00, 0x08,0x04,0x08,0x10,0x08,
+        };
+
+        // Статическая локальная переменная инициализируется ровно один раз (в том числе при работе из нескольких потоков).
+        static const GlyphAtlas atlas = []()
+        {
+            GlyphAtlas result;
+            result.row_offsets.push_back(0);
+
+            for (int glyph = 0; glyph < glyph_count; ++glyph)
+            {
+                for (int row = 0; row < glyph_height; ++row)
+                {
+                    // Ищу в строке глифа непрерывные отрезки закрашенных пикселей.
+                    for (int column = 0; column < glyph_width; )
+                    {
+                        if (!((font[glyph * glyph_width + column] >> row) & 1)) { ++column; continue; }
+
+                        int start = column;
+                        while (column < glyph_width && ((font[glyph * glyph_width + column] >> row) & 1)) { ++column; }
+
+                        result.runs.push_back({ static_cast<uint8_t>(start), static_cast<uint8_t>(column - start) });
+                    }
+
+                    result.row_offsets.push_back(static_cast<uint16_t>(result.runs.size()));
+                }
+            }
+
+            return result;
+        }();
+
+        return atlas;
+    }
+
+public:
+    // Структура, описывающая точку (вершину) на изображении.
+    struct Point
+    {
+        int x;
+        int y;
+    };
+
+    /*  Структура, описывающая один примитив для пакетной отрисовки (см. drawBatch).
+        Значение полей x0, y0, x1, y1 зависит от типа примитива:
+            Line       -> (x0, y0) и (x1, y1) - концы сглаженной линии;
+            Box        -> (x0, y0) - левый верхний угол, x1 - ширина, y1 - высота (только контур);
+            FilledRect -> то же самое, что и Box, но прямоугольник закрашивается;
+            Cross      -> (x0, y0) - центр крестика, x1 - полуразмер;
+            Ellipse    -> (x0, y0) - центр, x1 и y1 - полуоси;
+            Polygon    -> вершины берутся из vertices.
+        Для удобства создания примитивов есть статические методы line(), box(), и т.д.  */
+    struct DrawCommand
+    {
+        enum class Type { Line, Box, FilledRect, Cross, Ellipse, Polygon };
+
+        Type type = Type::Line;
+        int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+        uint32_t color = 0;
+        uint8_t alpha = 255;
+        std::vector<Point> vertices;
+
+        static DrawCommand line(int x0, int y0, int x1, int y1, uint8_t blue = 0, uint8_t green = 0, uint8_t red = 0, uint8_t alpha = 255)
+        {
+            return make(Type::Line, x0, y0, x1, y1, blue, green, red, alpha);
+        }
+
+        static DrawCommand box(int x, int y, int width, int height, uint8_t blue = 0, uint8_t green = 0, uint8_t red = 0, uint8_t alpha = 255)
+        {
+            return make(Type::Box, x, y, width, height, blue, green, red, alpha);
+        }
+
+        static DrawCommand filledRect(int x, int y, int width, int height, uint8_t blue = 0, uint8_t green = 0, uint8_t red = 0, uint8_t alpha = 255)
+        {
+            return make(Type::FilledRect, x, y, width, height, blue, green, red, alpha);
+        }
+
+        static DrawCommand cross(int center_x, int center_y, int half_size, uint8_t blue = 0, uint8_t green = 0, uint8_t red = 0, uint8_t alpha = 255)
+        {
+            return make(Type::Cross, center_x, center_y, half_size, 0, blue, green, red, alpha);
+        }
+
+        static DrawCommand ellipse(int center_x, int center_y, int radius_x, int radius_y, uint8_t blue = 0, uint8_t green = 0, uint8_t red = 0, uint8_t alpha = 255)
+        {
+            return make(Type::Ellipse, center_x, center_y, radius_x, radius_y, blue, green, red, alpha);
+        }
+
+        static DrawCommand polygon(std::vector<Point> vertices, uint8_t blue = 0, uint8_t green = 0, uint8_t red = 0, uint8_t alpha = 255)
+        {
+            DrawCommand command = make(Type::Polygon, 0, 0, 0, 0, blue, green, red, alpha);
+            command.vertices = std::move(vertices);
+            return command;
+        }
+
+    private:
+        static DrawCommand make(Type type, int x0, int y0, int x1, int y1, uint8_t blue, uint8_t green, uint8_t red, uint8_t alpha)
+        {
+            DrawCommand command;
+            command.type = type;
+            command.x0 = x0;
+            command.y0 = y0;
+            command.x1 = x1;
+            command.y1 = y1;
+            command.color = (blue << 16) | (green << 8) | red;
+            command.alpha = alpha;
+            return command;
+        }
+    };
+
+    /*  Таблица сумм (summed-area table, "интегральное изображение"): элемент (x, y) хранит суммы каналов
+        всех пикселей прямоугольника [0, x) x [0, y). С ее помощью сумма по любому прямоугольнику
+        вычисляется за 4 обращения к памяти независимо от его размера. Создается методом buildSummedAreaTable.
+        Суммы хранятся 32-битными числами "по модулю 2^32": разность четырех элементов все равно дает точную
+        сумму, если она меньше 2^32, а большие прямоугольники rectSum сам разбивает на полосы.
+        Это вдвое экономит память по сравнению с 64-битными суммами (12 байт на пиксель вместо 24).  */
+    class SummedAreaTable
+    {
+    public:
+        // Суммы каналов по прямоугольнику и количество пикселей в нем.
+        struct Sums
+        {
+            uint64_t blue  = 0;
+            uint64_t green = 0;
+            uint64_t red   = 0;
+            uint64_t area  = 0;
+        };
+
+        // Метод, возвращающий суммы каналов по прямоугольнику (x, y, width, height), обрезанному по границам изображения.
+        Sums rectSum(int x, int y, int width, int height) const
+        {
+            Sums result;
+
+            int x_begin = std::clamp(x, 0, table_width), x_end = std::clamp(x + width, 0, table_width);
+            int y_begin = std::clamp(y, 0, table_height), y_end = std::clamp(y + height, 0, table_height);
+
+            if (x_begin >= x_end || y_begin >= y_end) { return result; }
+
+            // Высота полосы, сумма по которой гарантированно меньше 2^32 (255 * площадь < 2^32).
+            int strip_height = static_cast<int>(std::max<uint64_t>(1, (UINT32_MAX / 255) / (x_end - x_begin)));
+
+            for (int top = y_begin; top < y_end; top += strip_height)
+            {
+                int bottom = std::min(top + strip_height, y_end);
+
+                for (int channel = 0; channel < 3; ++channel)
+                {
+                    uint32_t sum = at(x_end, bottom, channel) - at(x_begin, bottom, channel)
+                                 - at(x_end, top, channel) + at(x_begin, top, channel);
+
+                    (channel == 0 ? result.red : channel == 1 ? result.green : result.blue) += sum;
+                }
+            }
+
+            result.area = static_cast<uint64_t>(x_end - x_begin) * (y_end - y_begin);
+            return result;
+        }
+
+    private:
+        friend class BMPImageEditor;
+
+        int table_width  = 0;
+        int table_height = 0;
+
+        // (table_width + 1) * (table_height + 1) элементов по 3 канала (красный, зеленый, синий).
+        std::vector<uint32_t> table;
+
+        uint32_t at(int x, int y, int channel) const { return table[(static_cast<size_t>(y) * (table_width + 1) + x) * 3 + channel]; }
+    };
+
+    /*  Представление (view) прямоугольной области изображения без копирования пикселей. Создается методом view
+        и остается действительным, пока размеры изображения не меняются. Строки изображения хранятся отдельными
+        векторами, поэтому вместо пары "указатель + шаг строки" представление хранит указатель на строки
+        изображения и смещение области: строка y представления - это rows[top + y].data() + left.  */
+    class ImageView
+    {
+    public:
+        int width()  const { return view_width; }
+        int height() const { return view_height; }
+
+        // Метод, возвращающий указатель на начало строки y области.
+        uint32_t* row(int y) const { return rows[top + y].data() + left; }
+
+        // Метод, возвращающий ссылку на пиксель (x, y) области.
+        uint32_t& at(int x, int y) const { return row(y)[x]; }
+
+        // Метод, возвращающий представление прямоугольника (x, y, width, height) внутри этой области.
+        ImageView subview(int x, int y, int width, int height) const
+        {
+            if (x < 0 || y < 0 || width <= 0 || height <= 0 || x + width > view_width || y + height > view_height) {
+                throw std::runtime_error("Error! The region must lie inside the image.");
+            }
+
+            return ImageView(rows, left + x, top + y, width, height);
+        }
+
+        // Метод, позволяющий закрасить всю область BGR-цветом с непрозрачностью alpha (см. fillSpan).
+        void fill(uint8_t blue = 0, uint8_t green = 0, uint8_t red = 0, uint8_t alpha = 255) const
+        {
+            uint32_t color = (blue << 16) | (green << 8) | red;
+
+            for (int y = 0; y < view_height; ++y)
+            {
+                if (alpha == 255) { std::fill_n(row(y), view_width, color); }
+                else              { blendSpan(row(y), nullptr, color, view_width, alpha); }
+            }
+        }
+
+    private:
+        friend class BMPImageEditor;
+
+        ImageView(std::vector<uint32_t>* rows, int left, int top, int width, int height)
+            : rows(rows), left(left), top(top), view_width(width), view_height(height) {}
+
+        std::vector<uint32_t>* rows;
+        int left, top;
+        int view_width, view_height;
+    };
+
+    // Гистограммы каналов и яркости (см. histogram): элемент i - количество пикселей со значением i.
+    struct Histogram
+    {
+        std::array<uint64_t, 256> blue{};
+        std::array<uint64_t, 256> green{};
+        std::array<uint64_t, 256> red{};
+        std::array<uint64_t, 256> luminance{};
+    };
+
+    /*  Таблица поточечного преобразования цвета: значение v канала заменяется на blue[v], green[v] или red[v].
+        Гамма, яркость и контраст, инверсия, уровни и кривые - это такие таблицы, а последовательность
+        преобразований сводится к одной таблице (см. then), поэтому любое их количество применяется
+        к изображению за один проход (см. applyLookupTable). По умолчанию таблица тождественная.  */
+    class LookupTable
+    {
+    public:
+        std::array<uint8_t, 256> blue, green, red;
+
+        LookupTable()
+        {
+            for (int value = 0; value < 256; ++value) { blue[value] = green[value] = red[value] = static_cast<uint8_t>(value); }
+        }
+
+        // Таблица, которая применяет функцию function (0..255 -> вещественное число) ко всем каналам с округлением.
+        template <typename Function>
+        static LookupTable fromFunction(const Function& function)
+        {
+            LookupTable result;
+
+            for (int value = 0; value < 256; ++value) {
+                result.blue[value] = result.green[value] = result.red[value] = static_cast<uint8_t>(std::clamp(std::lround(function(value)), 0L, 255L));
+            }
+
+            return result;
+        }
+
+        // Гамма-коррекция: v -> 255 * (v / 255)^(1 / gamma) (gamma > 1 осветляет изображение).
+        static LookupTable gamma(double gamma)
+        {
+            if (gamma <= 0.0) {
+                throw std::runtime_error("Error! The gamma must be positive.");
+            }
+
+            return fromFunction([gamma](int value) { return 255.0 * std::pow(value / 255.0, 1.0 / gamma); });
+        }
+
+        // Яркость и контраст: v -> (v - 128) * contrast + 128 + brightness.
+        static LookupTable brightnessContrast(int brightness, double contrast = 1.0)
+        {
+            return fromFunction([=](int value) { return (value - 128) * contrast + 128 + brightness; });
+        }
+
+        // Инверсия (негатив): v -> 255 - v.
+        static LookupTable invert()
+        {
+            return fromFunction([](int value) { return 255 - value; });
+        }
+
+        /*  Уровни: диапазон [input_black, input_white] растягивается на [output_black, output_white]
+            с гамма-коррекцией gamma посередине (значения за пределами входного диапазона обрезаются).  */
+        static LookupTable levels(int input_black, int input_white, double gamma = 1.0, int output_black = 0, int output_white = 255)
+        {
+            if (input_black >= input_white || gamma <= 0.0) {
+                throw std::runtime_error("Error! The input range of the levels must not be empty and the gamma must be positive.");
+            }
+
+            return fromFunction([=](int value)
+            {
+                double position = std::clamp((value - input_black) / static_cast<double>(input_white - input_black), 0.0, 1.0);
+                return output_black + (output_white - output_black) * std::pow(position, 1.0 / gamma);
+            });
+        }
+
+        /*  Тоновая кривая, проходящая через точки points (x - входное значение, y - выходное, x строго возрастают).
+            Между точками кривая - монотонный кубический сплайн (Фрич - Карлсон): он гладкий и, в отличие
+            от обычного сплайна, не "выскакивает" за значения соседних точек. Левее первой и правее последней
+            точки кривая постоянна.  */
+        static LookupTable curve(const std::vector<Point>& points)
+        {
+            int count = points.size();
+
+            if (count < 2) {
+                throw std::runtime_error("Error! The curve must contain at least two points.");
+            }
+
+            for (int i = 1; i < count; ++i)
+            {
+                if (points[i].x <= points[i - 1].x) {
+                    throw std::runtime_error("Error! The points of the curve must be sorted by x without repetitions.");
+                }
+            }
+
+            // Наклоны отрезков и касательные в точках (касательные ограничиваются, чтобы сохранить монотонность).
+            std::vector<double> slopes(count - 1), tangents(count);
+            for (int i = 0; i + 1 < count; ++i) { slopes[i] = static_cast<double>(points[i + 1].y - points[i].y) / (points[i + 1].x - points[i].x); }
+
+            tangents[0] = slopes[0];
+            tangents[count - 1] = slopes[count - 2];
+
+            for (int i = 1; i + 1 < count; ++i) { tangents[i] = (slopes[i - 1] * slopes[i] <= 0.0) ? 0.0 : (slopes[i - 1] + slopes[i]) / 2.0; }
+
+            for (int i = 0; i + 1 < count; ++i)
+            {
+                if (slopes[i] == 0.0) { tangents[i] = tangents[i + 1] = 0.0; continue; }
+
+                double alpha = tangents[i] / slopes[i], beta = tangents[i + 1] / slopes[i];
+                double length = std::hypot(alpha, beta);
+
+                if (length > 3.0)
+                {
+                    tangents[i]     = 3.0 * alpha / length * slopes[i];
+                    tangents[i + 1] = 3.0 * beta / length * slopes[i];
+                }
+            }
+
+            return fromFunction([&](int value)
+            {
+                if (value <= points[0].x)         { return static_cast<double>(points[0].y); }
+                if (value >= points[count - 1].x) { return static_cast<double>(points[count - 1].y); }
+
+                int i = 0;
+                while (value > points[i + 1].x) { ++i; }
+
+                // Кубический полином Эрмита на отрезке [points[i].x, points[i + 1].x].
+                double step = points[i + 1].x - points[i].x;
+                double t = (value - points[i].x) / step;
+
+                return (2 * t * t * t - 3 * t * t + 1) * points[i].y + (t * t * t - 2 * t * t + t) * step * tangents[i]
+                     + (-2 * t * t * t + 3 * t * t) * points[i + 1].y + (t * t * t - t * t) * step * tangents[i + 1];
+            });
+        }
+
+        // Таблица, у которой каналы взяты из трех разных таблиц (например, чтобы применить кривую только к красному каналу).
+        static LookupTable perChannel(const LookupTable& blue, const LookupTable& green, const LookupTable& red)
+        {
+            LookupTable result;
+            result.blue  = blue.blue;
+            result.green = green.green;
+            result.red   = red.red;
+            return result;
+        }
+
+        // Таблица, равносильная применению сначала этой таблицы, а затем таблицы next.
+        LookupTable then(const LookupTable& next) const
+        {
+            LookupTable result;
+
+            for (int value = 0; value < 256; ++value)
+            {
+                result.blue[value]  = next.blue[blue[value]];
+                result.green[value] = next.green[green[value]];
+                result.red[value]   = next.red[red[value]];
+            }
+
+            return result;
+        }
+
+        bool isIdentity() const { return *this == LookupTable(); }
+
+        bool operator==(const LookupTable& other) const { return blue == other.blue && green == other.green && red == other.red; }
+    };
+
+    /*  Одноканальное 8-битное (полутоновое) изображение: один байт яркости на пиксель, то есть вчетверо меньше
+        памяти, чем у цветного изображения. Создается методом toGrayImage и сохраняется как 8-битный BMP с палитрой
+        из 256 оттенков серого. Строки хранятся подряд (сверху вниз) с шагом stride(), выровненным по 4 байта,
+        как строки 8-битного BMP-файла, поэтому при сохранении строки записываются без преобразований.  */
+    class GrayImage
+    {
+    public:
+        int width()  const { return image_width; }
+        int height() const { return image_height; }
+        int stride() const { return image_stride; }
+
+        uint8_t* row(int y) { return data.data() + static_cast<size_t>(y) * image_stride; }
+        const uint8_t* row(int y) const { return data.data() + static_cast<size_t>(y) * image_stride; }
+
+        uint8_t& at(int x, int y) { return row(y)[x]; }
+        uint8_t at(int x, int y) const { return row(y)[x]; }
+
+        // Метод, позволяющий сохранить изображение как 8-битный BMP-файл с палитрой оттенков серого.
+        void save(const std::string& file_path) const
+        {
+            std::vector<uint32_t> palette(256);
+            for (uint32_t value = 0; value < 256; ++value) { palette[value] = (value << 16) | (value << 8) | value; }
+
+            writeIndexedFile(file_path, file_header, info_block, data.data(), image_stride, image_width, image_height, 8, palette);
+        }
+
+    private:
+        friend class BMPImageEditor;
+
+        GrayImage(const BMPImageEditor& source, int width, int height)
+            : image_width(width), image_height(height), image_stride((width + 3) & ~3),
+              data(static_cast<size_t>(image_stride) * height, 0), file_header(source.file_header), info_block(source.info_block) {}
+
+        int image_width, image_height, image_stride;
+        std::vector<uint8_t> data;
+
+        // Заголовки исходного изображения (из них при сохранении берутся разрешение и прочие поля).
+        BMPFileHeader file_header;
+        BMPFileInfoBlock info_block;
+    };
+
+    /*  Перечисление, описывающее цветовое пространство (см. toColorSpace): HSV (тон 0..360 градусов,
+        насыщенность и значение 0..1), HSL (тон 0..360, насыщенность и светлота 0..1), полнодиапазонный
+        YCbCr ITU-R BT.601 (все компоненты 0..255) и CIE L*a*b* с белой точкой D65 (L* 0..100, a* и b* примерно -128..127).  */
+    enum class ColorSpace { HSV, HSL, YCbCr, Lab };
+
+    /*  Изображение в цветовом пространстве space(), разложенное на три плоскости чисел с плавающей точкой
+        (по одной на компоненту: например, для HSV plane(0) - тон, plane(1) - насыщенность, plane(2) - значение).
+        Строки каждой плоскости хранятся подряд сверху вниз, так что фильтры и маски работают с непрерывными массивами.
+        Создается методом toColorSpace, обратно в пиксели переводится методом fromColorSpace.  */
+    class ColorPlanes
+    {
+    public:
+        int width()  const { return image_width; }
+        int height() const { return image_height; }
+        ColorSpace space() const { return color_space; }
+
+        float* plane(int channel) { return data[channel].data(); }
+        const float* plane(int channel) const { return data[channel].data(); }
+
+        float* row(int channel, int y) { return plane(channel) + static_cast<size_t>(y) * image_width; }
+        const float* row(int channel, int y) const { return plane(channel) + static_cast<size_t>(y) * image_width; }
+
+        float& at(int channel, int x, int y) { return row(channel, y)[x]; }
+        float at(int channel, int x, int y) const { return row(channel, y)[x]; }
+
+    private:
+        friend class BMPImageEditor;
+
+        ColorPlanes(ColorSpace space, int width, int height) : color_space(space), image_width(width), image_height(height)
+        {
+            for (std::vector<float>& channel : data) { channel.resize(static_cast<size_t>(width) * height); }
+        }
+
+        ColorSpace color_space;
+        int image_width, image_height;
+        std::array<std::vector<float>, 3> data;
+    };
+
+    /*  Изображение в планарном виде (структура массивов): синий, зеленый и красный каналы (и, по желанию,
+        необязательный альфа-канал) хранятся отдельными плоскостями байтов. Строки каждой плоскости идут подряд
+        сверху вниз с шагом stride(), выровненным по 16 байт, так что многопроходные SIMD-фильтры работают
+        с непрерывными массивами одного канала и не распаковывают пиксели на каждом проходе. plane и row
+        возвращают указатели прямо в хранилище - преобразований при доступе нет.
+        Создается методами toPlanar и readPlanar (байты файла раскладываются по плоскостям прямо при чтении),
+        в пиксели переводится методом fromPlanar, а save собирает байты файла прямо из плоскостей.
+        Альфа-канал при создании заполняется значением 255 и в 24-битный файл не записывается.  */
+    class PlanarImage
+    {
+    public:
+        // Номера плоскостей.
+        static const int blue = 0, green = 1, red = 2, alpha = 3;
+
+        int width()    const { return image_width; }
+        int height()   const { return image_height; }
+        int stride()   const { return image_stride; }
+        int channels() const { return static_cast<int>(data.size()); }
+        bool hasAlpha() const { return data.size() == 4; }
+
+        uint8_t* plane(int channel) { return data[channel].data(); }
+        const uint8_t* plane(int channel) const { return data[channel].data(); }
+
+        uint8_t* row(int channel, int y) { return plane(channel) + static_cast<size_t>(y) * image_stride; }
+        const uint8_t* row(int channel, int y) const { return plane(channel) + static_cast<size_t>(y) * image_stride; }
+
+        uint8_t& at(int channel, int x, int y) { return row(channel, y)[x]; }
+        uint8_t at(int channel, int x, int y) const { return row(channel, y)[x]; }
+
+        // Метод, позволяющий сохранить изображение как 24-битный BMP-файл (строки файла собираются из плоскостей).
+        void save(const std::string& file_path) const
+        {
+            writePlanarFile(file_path, file_header, info_block, *this);
+        }
+
+    private:
+        friend class BMPImageEditor;
+
+        PlanarImage(const BMPImageEditor& source, int width, int height, bool with_alpha)
+            : image_width(width), image_height(height), image_stride((width + 15) & ~15), data(with_alpha ? 4 : 3),
+              file_header(source.file_header), info_block(source.info_block)
+        {
+            for (std::vector<uint8_t>& channel : data) { channel.resize(static_cast<size_t>(image_stride) * height, 0); }
+            if (with_alpha) { std::fill(data[alpha].begin(), data[alpha].end(), 255); }
+        }
+
+        int image_width, image_height, image_stride;
+        std::vector<std::vector<uint8_t>> data;
+
+        // Заголовки исходного изображения (из них при сохранении берутся разрешение и прочие поля).
+        BMPFileHeader file_header;
+        BMPFileInfoBlock info_block;
+    };
+
+    /*  Двуцветное (1-битное) изображение: по биту на пиксель, то есть в 24 раза меньше, чем в 24-битном файле.
+        Создается методами threshold, thresholdOtsu и thresholdAdaptive. Строки хранятся подряд (сверху вниз)
+        с шагом stride(), выровненным по 4 байта, а биты в байте идут от старшего к младшему (левый пиксель -
+        старший бит) - ровно как в строках 1-битного BMP-файла, поэтому save записывает строки без преобразований.
+        Бит 1 - белый пиксель, бит 0 - черный.  */
+    class BinaryImage
+    {
+    public:
+        int width()  const { return image_width; }
+        int height() const { return image_height; }
+        int stride() const { return image_stride; }
+
+        uint8_t* row(int y) { return data.data() + static_cast<size_t>(y) * image_stride; }
+        const uint8_t* row(int y) const { return data.data() + static_cast<size_t>(y) * image_stride; }
+
+        bool at(int x, int y) const { return (row(y)[x >> 3] >> (7 - (x & 7))) & 1; }
+
+        void set(int x, int y, bool value)
+        {
+            uint8_t bit = 0x80 >> (x & 7);
+            row(y)[x >> 3] = value ? (row(y)[x >> 3] | bit) : (row(y)[x >> 3] & ~bit);
+        }
+
+        // Метод, позволяющий сохранить изображение как 1-битный BMP-файл с палитрой из черного и белого цветов.
+        void save(const std::string& file_path) const
+        {
+            writeIndexedFile(file_path, file_header, info_block, data.data(), image_stride, image_width, image_height, 1, { 0x00'0000, 0xFF'FFFF });
+        }
+
+    private:
+        friend class BMPImageEditor;
+
+        BinaryImage(const BMPImageEditor& source, int width, int height)
+            : image_width(width), image_height(height), image_stride(((width + 31) / 32) * 4),
+              data(static_cast<size_t>(image_stride) * height, 0), file_header(source.file_header), info_block(source.info_block) {}
+
+        int image_width, image_height, image_stride;
+        std::vector<uint8_t> data;
+
+        // Заголовки исходного изображения (из них при сохранении берутся разрешение и прочие поля).
+        BMPFileHeader file_header;
+        BMPFileInfoBlock info_block;
+    };
+
+    /*  Перечисление, описывающее способ вычисления локального порога (см. thresholdAdaptive): среднее по квадратному
+        окну или взвешенное среднее с весами, приближающими гауссиан (вложенные окна с убывающими весами).  */
+    enum class ThresholdMethod { Mean, Gaussian };
+
+    /*  Перечисление, описывающее морфологическую операцию (см. morphology) с прямоугольным структурным элементом:
+        эрозия (минимум по окну), дилатация (максимум по окну), размыкание (эрозия, затем дилатация)
+        и замыкание (дилатация, затем эрозия). У двуцветного изображения минимум и максимум - это "и" и "или"
+        (то есть эрозия уменьшает белые области).  */
+    enum class MorphologyOperation { Erode, Dilate, Open, Close };
+
+    /*  Перечисление, описывающее оператор градиента (см. gradientMagnitude): оператор Собеля (веса 1, 2, 1)
+        или оператор Шарра (веса 3, 10, 3 - точнее передает направление градиента).  */
+    enum class GradientOperator { Sobel, Scharr };
+
+    /*  Перечисление, описывающее поворот или отражение изображения (см. reorient и save):
+        повороты по часовой стрелке на 90, 180 и 270 градусов, отражения слева направо и сверху вниз,
+        транспонирование (отражение относительно главной диагонали) и отражение относительно побочной диагонали.  */
+    enum class Orientation { Normal, Rotate90, Rotate180, Rotate270, FlipHorizontal, FlipVertical, Transpose, Transverse };
+
+    /*  Перечисление, описывающее фильтр ресемплинга (см. resize): билинейный (треугольный, радиус 1),
+        бикубический (Keys, a = -0.5, радиус 2) и фильтр Ланцоша (радиус 3).  */
+    enum class ResampleFilter { Bilinear, Bicubic, Lanczos3 };
+
+    BMPImageEditor() = default;
+
+    // Метод, позволяющий считать все данные из входного файла.
+    void read(const std::string& file_path) 
+    {
+        /* 1.   Открываю входной файл, считываю и проверяю заголовки (см. openFile).
+                Позиция чтения после этого находится в начале данных о пикселях.  */
+        std::ifstream inp_file = openFile(file_path);
+
+        /* 2.   Так как данные о пикселях в файле обычно располагаются с учетом
+                выравнивания, то я рассчитываю реальный размер строки, учитывая вышеупомянутый момент.   */
+        int bytes_per_pixel = info_block.color_depth_in_bits / 8;
+        int row_size = (info_block.width * bytes_per_pixel + 3) & (~3);
+
+        /* 3.   Выделяю необходимую память для матрицы pixels (assign, а не resize: при повторном чтении
+                в тот же объект строки прежнего размера тоже должны замениться).  */
+        pixels.assign(info_block.height, std::vector<uint32_t>(info_block.width));
+
+        // 4. Начинаю считывать информацию о пикселях - строку файла целиком за одно обращение к потоку:
+        std::vector<uint8_t> row_data(row_size);
+
+        for (int y = 0; y < info_block.height; ++y)
+        {
+            /* 4.1  Определяю правильный индекс строки в изображении
+                    (иначе изображение выводится вверх ногами).  */
+            int row_index = info_block.height - y - 1;
+
+            /* 4.2  Считываю строку вместе с байтами выравнивания и проверяю наличие ошибок.
+                    Напоминаю, каждый пиксель представлен 3 байтами:
+                    1-й байт -> синий, 2-й байт -> зеленый, 3-й байт -> красный (см. decodeRow).  */
+            inp_file.read(reinterpret_cast<char*>(row_data.data()), row_size);
+            if (inp_file.fail()) { throw std::runtime_error("Oops! An error occurred while reading the file."); }
+
+            decodeRow(row_data.data(), info_block.width, pixels[row_index].data());
+        }
+
+        // 5. Закрываю поток чтения входного файла и меняю флаг fileWasRead на соответствующее значение.
+        inp_file.close();
+        fileWasRead = true;
+    }
+
+    /*  Метод, позволяющий нарисовать крест на изображении. Пользователь может выбрать, 
+        каким цветом ему нарисовать крест -> для этого ему достаточно ввести BGR-последовательность
+        (по умолчанию - крест рисуется черным цветом). Последний параметр - непрозрачность креста
+        (255 -> пиксели перезаписываются, меньшие значения -> цвет смешивается с изображением).  */
+    void drawCross(uint8_t blue = 0, uint8_t green = 0, uint8_t red = 0, uint8_t alpha = 255)
+    {        
+        /* 1.   Если на момент вызова данной функции пользователь 
+                еще не считал данные из файла - выбрасываю исключение с соответствующим сообщением.   */
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        // 2. Интерпретирую входные цвета как единое 4х-байтовое число.
+        uint32_t color = (blue << 16) | (green << 8) | red;
+
+        /* 3.   Рисую крест, который проходит по главным диагоналям изображения.
+                Если крест полупрозрачный, то цвет смешивается с исходными пикселями
+                (пиксель на пересечении диагоналей смешивается только один раз).  */
+        for (int i = 0; i < std::min(info_block.height, info_block.width); ++i)
+        {
+            int mirrored = info_block.width - i - 1;
+
+            if (alpha == 255)
+            {
+                pixels[i][i] = color;
+                pixels[i][mirrored] = color;
+            }
+            else
+            {
+                blendPixel(i, i, color, alpha);
+                if (mirrored != i) { blendPixel(mirrored, i, color, alpha); }
+            }
+        }
+    }
+
+    /*  Метод, позволяющий нарисовать сглаженную (anti-aliased) линию из точки (x0, y0) в точку (x1, y1)
+        по алгоритму Ву (Xiaolin Wu). Цвет задается BGR-последовательностью (по умолчанию - черный).
+        Наклон линии хранится в формате с фиксированной точкой 16.16, поэтому во внутреннем цикле
+        нет ни одной операции с плавающей точкой. Части линии за пределами изображения отсекаются.  */
+    void drawLineAA(int x0, int y0, int x1, int y1, uint8_t blue = 0, uint8_t green = 0, uint8_t red = 0, uint8_t alpha = 255)
+    {
+        // Без считанного файла рисовать не на чем.
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        uint32_t color = (blue << 16) | (green << 8) | red;
+        rasterizeLineAA(x0, y0, x1, y1, color, alpha, 0, info_block.height);
+    }
+
+    // Метод, позволяющий закрасить прямоугольник с левым верхним углом (x, y), шириной width и высотой height.
+    void fillRect(int x, int y, int width, int height, uint8_t blue = 0, uint8_t green = 0, uint8_t red = 0, uint8_t alpha = 255)
+    {
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        uint32_t color = (blue << 16) | (green << 8) | red;
+        rasterizeRect(x, y, width, height, color, alpha, 0, info_block.height);
+    }
+
+    /*  Метод, позволяющий закрасить эллипс с центром в пикселе (center_x, center_y) и полуосями
+        radius_x, radius_y (круг - частный случай, когда полуоси равны). Для каждой строки полуширина
+        эллипса вычисляется один раз, после чего вся строка эллипса заливается одним отрезком.  */
+    void fillEllipse(int center_x, int center_y, int radius_x, int radius_y, uint8_t blue = 0, uint8_t green = 0, uint8_t red = 0, uint8_t alpha = 255)
+    {
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        if (radius_x < 0 || radius_y < 0) {
+            throw std::runtime_error("Error! The radii of the ellipse must not be negative.");
+        }
+
+        uint32_t color = (blue << 16) | (green << 8) | red;
+        rasterizeEllipse(center_x, center_y, radius_x, radius_y, color, alpha, 0, info_block.height);
+    }
+
+    /*  Метод, позволяющий закрасить произвольный многоугольник (в том числе невыпуклый и самопересекающийся)
+        по правилу "чет-нечет". Используется построчный (scanline) растеризатор с таблицей активных ребер:
+        ребра сортируются по верхней точке, на каждой строке в список активных добавляются начавшиеся ребра
+        и удаляются закончившиеся, а отрезки между парами пересечений заливаются целиком.
+        Пиксель считается закрашенным, если внутри многоугольника лежит его центр.  */
+    void fillPolygon(const std::vector<Point>& vertices, uint8_t blue = 0, uint8_t green = 0, uint8_t red = 0, uint8_t alpha = 255)
+    {
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        uint32_t color = (blue << 16) | (green << 8) | red;
+        rasterizePolygon(vertices, color, alpha, 0, info_block.height);
+    }
+
+    /*  Метод, позволяющий нарисовать за один проход целый список примитивов (пакетная отрисовка).
+        Вместо того чтобы рисовать примитивы по одному (и каждый раз заново проходить по всей памяти
+        изображения), метод разбивает изображение на горизонтальные полосы (тайлы), раскладывает
+        примитивы по полосам, которые они задевают, и затем рисует полосу за полосой -> пока полоса
+        обрабатывается, она целиком находится в кэше. Порядок наложения примитивов сохраняется.
+        Полосы не пересекаются, поэтому их можно рисовать в нескольких потоках одновременно
+        (thread_count = 0 -> по числу аппаратных потоков).  */
+    void drawBatch(const std::vector<DrawCommand>& commands, unsigned thread_count = 1)
+    {
+        // 1. Без считанного файла рисовать не на чем.
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        int height = info_block.height;
+        if (commands.empty() || height == 0) { return; }
+
+        /* 2.   Подбираю высоту полосы так, чтобы она занимала порядка 256 КБ
+                (примерно размер кэша L2), но не меньше 8 строк.  */
+        int tile_height = std::max<int>(8, (256 * 1024) / std::max<uint32_t>(1, info_block.width * sizeof(uint32_t)));
+        int tile_count = (height + tile_height - 1) / tile_height;
+
+        /* 3.   Раскладываю примитивы по полосам: в каждую полосу попадают номера
+                тех примитивов, чей диапазон строк ее задевает (в порядке добавления).  */
+        std::vector<std::vector<uint32_t>> bins(tile_count);
+
+        for (size_t i = 0; i < commands.size(); ++i)
+        {
+            int top = 0, bottom = 0;
+            commandRows(commands[i], top, bottom);
+
+            top    = std::max(top, 0);
+            bottom = std::min(bottom, height - 1);
+
+            for (int tile = top / tile_height; top <= bottom && tile <= bottom / tile_height; ++tile) {
+                bins[tile].push_back(static_cast<uint32_t>(i));
+            }
+        }
+
+        // 4. Рисую каждую полосу отдельно: все примитивы обрезаются по строкам полосы.
+        runParallel(tile_count, thread_count, [&](int tile)
+        {
+            int row_begin = tile * tile_height;
+            int row_end   = std::min(row_begin + tile_height, height);
+
+            for (uint32_t index : bins[tile]) { rasterizeCommand(commands[index], row_begin, row_end); }
+        });
+    }
+
+    /*  Метод, позволяющий написать на изображении текст встроенным моноширинным шрифтом 5x7.
+        (x, y) - левый верхний угол первого символа, scale - во сколько раз увеличить шрифт,
+        символ '\n' переносит текст на новую строку, а символы вне ASCII выводятся как '?'.
+        Каждая строка глифа берется из заранее построенного атласа в виде готовых отрезков,
+        которые заливаются целиком (с учетом масштаба), поэтому подпись стоит считанные микросекунды.  */
+    void drawText(int x, int y, const std::string& text, int scale = 1, uint8_t blue = 0, uint8_t green = 0, uint8_t red = 0, uint8_t alpha = 255)
+    {
+        // 1. Без считанного файла рисовать не на чем.
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        if (scale <= 0) {
+            throw std::runtime_error("Error! The scale of the text must be positive.");
+        }
+
+        uint32_t color = (blue << 16) | (green << 8) | red;
+        const GlyphAtlas& atlas = glyphAtlas();
+
+        int pen_x = x;
+        int pen_y = y;
+
+        for (unsigned char symbol : text)
+        {
+            // 2. Перенос строки: возвращаюсь к началу и опускаюсь на высоту строки.
+            if (symbol == '\n')
+            {
+                pen_x = x;
+                pen_y += line_advance * scale;
+                continue;
+            }
+
+            int glyph = (symbol >= 32 && symbol <= 126) ? symbol - 32 : '?' - 32;
+
+            // 3. Глифы, которые целиком лежат за пределами изображения, пропускаю.
+            bool visible = pen_x < static_cast<int>(info_block.width) && pen_x + glyph_width * scale > 0 &&
+                           pen_y < static_cast<int>(info_block.height) && pen_y + glyph_height * scale > 0;
+
+            for (int row = 0; visible && row < glyph_height; ++row)
+            {
+                int first_run = atlas.row_offsets[glyph * glyph_height + row];
+                int last_run  = atlas.row_offsets[glyph * glyph_height + row + 1];
+
+                // 4. Каждая строка глифа повторяется scale раз, а каждый отрезок растягивается в scale раз.
+                for (int repeat = 0; repeat < scale; ++repeat)
+                {
+                    int target_y = pen_y + row * scale + repeat;
+
+                    for (int run = first_run; run < last_run; ++run)
+                    {
+                        int span_begin = pen_x + atlas.runs[run].start * scale;
+                        fillSpan(target_y, span_begin, span_begin + atlas.runs[run].length * scale, color, alpha);
+                    }
+                }
+            }
+
+            pen_x += glyph_advance * scale;
+        }
+    }
+
+    // Метод, позволяющий узнать размер (ширину и высоту в пикселях), который займет текст в drawText.
+    static Point measureText(const std::string& text, int scale = 1)
+    {
+        int columns = 0, max_columns = 0, lines = text.empty() ? 0 : 1;
+
+        for (char symbol : text)
+        {
+            if (symbol == '\n') { ++lines; columns = 0; }
+            else { max_columns = std::max(max_columns, ++columns); }
+        }
+
+        return { max_columns * glyph_advance * scale, lines * line_advance * scale };
+    }
+
+    /*  Метод, позволяющий залить связную (по 4 направлениям) область, в которой лежит пиксель (x, y),
+        цветом blue, green, red ("ведро с краской"). Пиксель принадлежит области, если каждый его канал
+        отличается от соответствующего канала исходного пикселя (x, y) не более чем на tolerance
+        (tolerance = 0 -> точное совпадение цвета). Возвращает количество закрашенных пикселей.
+        Вместо рекурсии (которая на больших областях переполняет стек вызовов) используется
+        построчная заливка с явным стеком отрезков: каждая строка области заливается целым отрезком,
+        а в стек попадают только отрезки соседних строк, которые еще нужно проверить.  */
+    uint64_t floodFill(int x, int y, uint8_t blue = 0, uint8_t green = 0, uint8_t red = 0, uint8_t tolerance = 0)
+    {
+        // 1. Без считанного файла заливать нечего.
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        const int width  = info_block.width;
+        const int height = info_block.height;
+
+        if (x < 0 || y < 0 || x >= width || y >= height) { return 0; }
+
+        uint32_t color = (blue << 16) | (green << 8) | red;
+        uint32_t seed  = pixels[y][x] & 0xFF'FFFF;
+
+        /* 2.   Функтор, проверяющий, подходит ли цвет пикселя под условие заливки.
+                Для точного совпадения достаточно одного сравнения.  */
+        auto matches = [seed, tolerance](uint32_t value)
+        {
+            value &= 0xFF'FFFF;
+            if (tolerance == 0) { return value == seed; }
+
+            for (int shift = 0; shift < 24; shift += 8)
+            {
+                int difference = static_cast<int>((value >> shift) & 0xFF) - static_cast<int>((seed >> shift) & 0xFF);
+                if (std::abs(difference) > tolerance) { return false; }
+            }
+
+            return true;
+        };
+
+        /* 3.   Если цвет заливки сам подходит под условие (например, при допуске он близок к исходному),
+                то закрашенные пиксели нельзя отличить от незакрашенных. В этом случае дополнительно
+                веду битовую маску уже закрашенных пикселей (1 бит на пиксель).  */
+        bool needs_mask = matches(color);
+        if (needs_mask && tolerance == 0) { return 0; }
+
+        const size_t words_per_row = (width + 63) / 64;
+        std::vector<uint64_t> filled(needs_mask ? words_per_row * height : 0);
+
+        auto inside = [&](int px, int py)
+        {
+            if (!matches(pixels[py][px])) { return false; }
+            return !needs_mask || !((filled[py * words_per_row + px / 64] >> (px % 64)) & 1);
+        };
+
+        uint64_t count = 0;
+
+        // Функтор, закрашивающий отрезок [x_begin, x_end) строки py.
+        auto fill = [&](int py, int x_begin, int x_end)
+        {
+            std::fill_n(pixels[py].data() + x_begin, x_end - x_begin, color);
+            count += x_end - x_begin;
+
+            if (needs_mask) {
+                for (int px = x_begin; px < x_end; ++px) { filled[py * words_per_row + px / 64] |= uint64_t(1) << (px % 64); }
+            }
+        };
+
+        /* 4.   Явный стек отрезков. Элемент стека: отрезок [x_begin, x_end] строки y, который нужно
+                проверить, и направление dy, в котором мы пришли в эту строку. Память под стек
+                выделяется заранее, чтобы на больших областях не тратить время на перераспределения.  */
+        struct Span
+        {
+            int x_begin;
+            int x_end;
+            int y;
+            int dy;
+        };
+
+        std::vector<Span> stack;
+        stack.reserve(4 * static_cast<size_t>(height) + 64);
+
+        stack.push_back({ x, x, y, 1 });
+        stack.push_back({ x, x, y - 1, -1 });
+
+        while (!stack.empty())
+        {
+            Span span = stack.back();
+            stack.pop_back();
+
+            if (span.y < 0 || span.y >= height) { continue; }
+
+            int x1 = span.x_begin;
+            int x2 = span.x_end;
+            int row = span.y;
+            int left = x1;
+
+            /* 4.1  Если левый край отрезка лежит внутри области, то продлеваю заливку влево.
+                    Если область "вылезла" левее отрезка, то ее нужно проверить и в обратном направлении.  */
+            if (inside(left, row))
+            {
+                while (left > 0 && inside(left - 1, row)) { --left; }
+                fill(row, left, x1);
+
+                if (left < x1) { stack.push_back({ left, x1 - 1, row - span.dy, -span.dy }); }
+            }
+
+            // 4.2 Прохожу отрезок слева направо, заливая найденные участки области целиком.
+            while (x1 <= x2)
+            {
+                int right = x1;
+                while (right < width && inside(right, row)) { ++right; }
+                fill(row, x1, right);
+
+                // Участок [left, right) продолжаю проверять в том же направлении...
+                if (right > left) { stack.push_back({ left, right - 1, row + span.dy, span.dy }); }
+
+                // ...а если он вышел за правый край отрезка, то и в обратном.
+                if (right - 1 > x2) { stack.push_back({ x2 + 1, right - 1, row - span.dy, -span.dy }); }
+
+                // Пропускаю пиксели, которые не принадлежат области.
+                x1 = right + 1;
+                while (x1 < x2 && !inside(x1, row)) { ++x1; }
+                left = x1;
+            }
+        }
+
+        return count;
+    }
+
+    /*  Метод, позволяющий наложить изображение source на текущее изображение так, чтобы левый верхний
+        угол source оказался в точке (x, y). Параметр alpha задает непрозрачность накладываемого
+        изображения (255 -> пиксели просто копируются). Части source за пределами изображения отсекаются,
+        а каждая строка смешивается SIMD-ядром blendSpan, поэтому наложение водяных знаков
+        упирается, по сути, только в пропускную способность памяти.  */
+    void composite(const BMPImageEditor& source, int x, int y, uint8_t alpha = 255)
+    {
+        // 1. Оба изображения должны быть считаны из файлов.
+        if (!fileWasRead || !source.fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        // 1.1 Если изображение накладывается само на себя, то работаю с его копией (строки могут перекрываться).
+        if (&source == this)
+        {
+            BMPImageEditor copy = source;
+            composite(copy, x, y, alpha);
+            return;
+        }
+
+        // 2. Вычисляю пересечение source с текущим изображением.
+        int x_begin = std::max(x, 0);
+        int y_begin = std::max(y, 0);
+        int x_end   = std::min(x + static_cast<int>(source.info_block.width), static_cast<int>(info_block.width));
+        int y_end   = std::min(y + static_cast<int>(source.info_block.height), static_cast<int>(info_block.height));
+
+        if (x_begin >= x_end || y_begin >= y_end || alpha == 0) { return; }
+
+        // 3. Смешиваю (или просто копирую) строку за строкой.
+        for (int row = y_begin; row < y_end; ++row)
+        {
+            uint32_t* destination = pixels[row].data() + x_begin;
+            const uint32_t* source_row = source.pixels[row - y].data() + (x_begin - x);
+
+            if (alpha == 255) { std::copy_n(source_row, x_end - x_begin, destination); }
+            else              { blendSpan(destination, source_row, 0, x_end - x_begin, alpha); }
+        }
+    }
+
+    /*  Метод, позволяющий применить к изображению свертку с произвольным ядром размера kernel_width x kernel_height
+        (веса задаются построчно в векторе kernel, центр ядра - элемент (kernel_width / 2, kernel_height / 2)).
+        За границами изображения считаются продолженными крайние пиксели. Если ядро оказывается сепарабельным
+        (то есть является произведением столбца на строку, как, например, гауссово), то автоматически
+        используется быстрый путь convolveSeparable. Изображение обрабатывается полосами строк
+        в thread_count потоках (0 -> по числу аппаратных потоков).  */
+    void convolve(const std::vector<float>& kernel, int kernel_width, int kernel_height, unsigned thread_count = 1)
+    {
+        // 1. Без считанного файла обрабатывать нечего.
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        if (kernel_width <= 0 || kernel_height <= 0 || kernel.size() != static_cast<size_t>(kernel_width) * kernel_height) {
+            throw std::runtime_error("Error! The size of the convolution kernel does not match its width and height.");
+        }
+
+        /* 2.   Проверяю, является ли ядро сепарабельным. Беру строку и столбец, на пересечении которых лежит
+                наибольший по модулю вес: если ядро сепарабельно, то kernel[y][x] = column[y] * row[x] / pivot.  */
+        size_t pivot = 0;
+        for (size_t i = 0; i < kernel.size(); ++i) {
+            if (std::fabs(kernel[i]) > std::fabs(kernel[pivot])) { pivot = i; }
+        }
+
+        if (kernel[pivot] == 0.0f)
+        {
+            convolveSeparable({ 0.0f }, { 0.0f }, thread_count);
+            return;
+        }
+
+        int pivot_x = pivot % kernel_width;
+        int pivot_y = pivot / kernel_width;
+
+        std::vector<float> horizontal(kernel.begin() + pivot_y * kernel_width, kernel.begin() + (pivot_y + 1) * kernel_width);
+        std::vector<float> vertical(kernel_height);
+        for (int y = 0; y < kernel_height; ++y) { vertical[y] = kernel[y * kernel_width + pivot_x] / kernel[pivot]; }
+
+        bool separable = true;
+        for (int y = 0; separable && y < kernel_height; ++y) {
+            for (int x = 0; separable && x < kernel_width; ++x) {
+                separable = std::fabs(vertical[y] * horizontal[x] - kernel[y * kernel_width + x]) <= 1e-5f * std::fabs(kernel[pivot]);
+            }
+        }
+
+        if (separable)
+        {
+            convolveSeparable(horizontal, vertical, thread_count);
+            return;
+        }
+
+        /* 3.   Общий случай. Веса перевожу в формат с фиксированной точкой (12 бит дробной части).
+                Подготовленная строка - это распакованная в 16 бит строка с дополнением по краям,
+                а каждый выходной пиксель - взвешенная сумма kernel_width * kernel_height таких значений.  */
+        std::vector<int16_t> weights = toFixedPoint(kernel);
+
+        int pad_left  = kernel_width / 2;
+        int pad_right = kernel_width - 1 - pad_left;
+        int width = info_block.width;
+
+        convolveRowBands(kernel_height / 2, kernel_height - 1 - kernel_height / 2, 4 * (width + kernel_width - 1), thread_count,
+            [&](const uint32_t* row, int16_t* prepared, ConvolutionScratch&)
+            {
+                expandRow(row, width, pad_left, pad_right, prepared);
+            },
+            [&](const int16_t* const* window, uint32_t* output, ConvolutionScratch& scratch)
+            {
+                // Указатель на каждый вес ядра - это строка окна, сдвинутая на нужное число пикселей.
+                scratch.sources.resize(kernel_width * kernel_height);
+
+                for (int y = 0; y < kernel_height; ++y) {
+                    for (int x = 0; x < kernel_width; ++x) { scratch.sources[y * kernel_width + x] = window[y] + 4 * x; }
+                }
+
+                weightedSum(scratch.sources.data(), weights.data(), kernel_width * kernel_height, 4 * width, scratch.sums.data());
+                packPixels(scratch.sums.data(), width, fixed_point_bits, output);
+            });
+    }
+
+    /*  Метод, позволяющий применить к изображению сепарабельную свертку: сначала каждая строка сворачивается
+        с ядром horizontal, затем результат сворачивается по столбцам с ядром vertical. Для ядра размера
+        N x M это стоит N + M умножений на канал вместо N * M. Горизонтально свернутые строки хранятся
+        в кольцевом буфере из vertical.size() строк (в 16-битном формате с фиксированной точкой),
+        поэтому дополнительная память не зависит от высоты изображения.  */
+    void convolveSeparable(const std::vector<float>& horizontal, const std::vector<float>& vertical, unsigned thread_count = 1)
+    {
+        // 1. Без считанного файла обрабатывать нечего.
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        if (horizontal.empty() || vertical.empty()) {
+            throw std::runtime_error("Error! The convolution kernel must not be empty.");
+        }
+
+        /* 2.   Веса обоих проходов перевожу в формат с фиксированной точкой (12 бит дробной части).
+                После горизонтального прохода в строке остается 4 дробных бита (это 16-битные
+                промежуточные значения), а после вертикального сумма делится на 2^(12 + 4).  */
+        std::vector<int16_t> horizontal_weights = toFixedPoint(horizontal);
+        std::vector<int16_t> vertical_weights   = toFixedPoint(vertical);
+
+        const int intermediate_bits = 4;
+        int taps      = horizontal.size();
+        int pad_left  = taps / 2;
+        int pad_right = taps - 1 - pad_left;
+        int width = info_block.width;
+        int kernel_height = vertical.size();
+
+        convolveRowBands(kernel_height / 2, kernel_height - 1 - kernel_height / 2, 4 * width, thread_count,
+            [&](const uint32_t* row, int16_t* prepared, ConvolutionScratch& scratch)
+            {
+                // 3. Горизонтальный проход: строка распаковывается и сворачивается с ядром horizontal.
+                scratch.expanded.resize(4 * (width + taps - 1));
+                scratch.sources.resize(taps);
+                expandRow(row, width, pad_left, pad_right, scratch.expanded.data());
+
+                for (int k = 0; k < taps; ++k) { scratch.sources[k] = scratch.expanded.data() + 4 * k; }
+
+                weightedSum(scratch.sources.data(), horizontal_weights.data(), taps, 4 * width, scratch.sums.data());
+                packSums(scratch.sums.data(), 4 * width, fixed_point_bits - intermediate_bits, prepared);
+            },
+            [&](const int16_t* const* window, uint32_t* output, ConvolutionScratch& scratch)
+            {
+                // 4. Вертикальный проход: взвешенная сумма строк кольцевого буфера.
+                weightedSum(window, vertical_weights.data(), kernel_height, 4 * width, scratch.sums.data());
+                packPixels(scratch.sums.data(), width, fixed_point_bits + intermediate_bits, output);
+            });
+    }
+
+    /*  Метод, позволяющий построить таблицу сумм (интегральное изображение) для текущего изображения.
+        Сначала в каждой строке считаются префиксные суммы (строки обрабатываются параллельно),
+        затем строки накапливаются сверху вниз (параллельно по полосам столбцов).  */
+    SummedAreaTable buildSummedAreaTable(unsigned thread_count = 1) const
+    {
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        SummedAreaTable result;
+        result.table_width  = info_block.width;
+        result.table_height = info_block.height;
+        result.table.assign((static_cast<size_t>(info_block.width) + 1) * (info_block.height + 1) * 3, 0);
+
+        const size_t stride = (static_cast<size_t>(info_block.width) + 1) * 3;
+        uint32_t* table = result.table.data();
+
+        // 1. Префиксные суммы каждой строки (строка y изображения -> строка y + 1 таблицы).
+        runParallel(info_block.height, thread_count, [&](int y)
+        {
+            uint32_t* row = table + (y + 1) * stride;
+            uint32_t red = 0, green = 0, blue = 0;
+
+            for (uint32_t x = 0; x < info_block.width; ++x)
+            {
+                uint32_t color = pixels[y][x];
+
+                red   += color & 0xFF;
+                green += (color >> 8) & 0xFF;
+                blue  += (color >> 16) & 0xFF;
+
+                row[(x + 1) * 3]     = red;
+                row[(x + 1) * 3 + 1] = green;
+                row[(x + 1) * 3 + 2] = blue;
+            }
+        });
+
+        // 2. Накопление по вертикали: к каждой строке таблицы прибавляю предыдущую (полосами по 64 столбца).
+        const int strip = 64 * 3;
+        int strip_count = static_cast<int>((stride + strip - 1) / strip);
+
+        runParallel(strip_count, thread_count, [&](int index)
+        {
+            size_t begin = index * strip;
+            size_t end   = std::min(begin + strip, stride);
+
+            for (uint32_t y = 2; y <= info_block.height; ++y)
+            {
+                uint32_t* row = table + y * stride;
+                const uint32_t* previous = row - stride;
+
+                for (size_t i = begin; i < end; ++i) { row[i] += previous[i]; }
+            }
+        });
+
+        return result;
+    }
+
+    /*  Метод, позволяющий посчитать гистограммы синего, зеленого и красного каналов и яркости (см. luminance).
+        Строки делятся на полосы, которые обрабатываются в thread_count потоках. Каждая полоса ведет
+        4 независимые копии счетчиков, а соседние пиксели попадают в разные копии: так подряд идущие
+        пиксели одного цвета не увеличивают один и тот же счетчик (процессору не приходится ждать, пока
+        предыдущее значение счетчика будет записано в память). Копии складываются в конце.  */
+    Histogram histogram(unsigned thread_count = 1) const
+    {
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        return histogramOfRows([&](int y) { return pixels[y].data(); }, info_block.width, info_block.height, thread_count);
+    }
+
+    // Метод, позволяющий посчитать гистограммы только для области region изображения (см. view).
+    static Histogram histogram(const ImageView& region, unsigned thread_count = 1)
+    {
+        return histogramOfRows([&](int y) { return region.row(y); }, region.width(), region.height(), thread_count);
+    }
+
+    /*  Метод, позволяющий применить к изображению таблицу преобразования цвета (см. LookupTable) за один проход.
+        Если таблица каждого канала линейна (v -> clamp(a * v + b), так устроены яркость/контраст, инверсия
+        и уровни без гаммы), то вместо обращений к таблицам используется SIMD-ядро transformSpan.
+        Линейность проверяется точно: ядро выбирается, только если оно дает в точности те же 256 значений
+        (коэффициенты ищутся с наибольшей точностью, при которой множитель еще помещается в 16 бит).  */
+    void applyLookupTable(const LookupTable& table, unsigned thread_count = 1)
+    {
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        if (table.isIdentity()) { return; }
+
+        // Коэффициенты в порядке байтов пикселя в памяти: красный, зеленый, синий, неиспользуемый байт.
+        int16_t scales[4] = { 0, 0, 0, 0 };
+        int32_t offsets[4] = { 0, 0, 0, 0 };
+
+        int shift = 15;
+        bool linear = false;
+
+        for (; shift >= 8 && !linear; --shift)
+        {
+            linear = findLinearTable(table.red, shift, scales[0], offsets[0]) && findLinearTable(table.green, shift, scales[1], offsets[1])
+                  && findLinearTable(table.blue, shift, scales[2], offsets[2]);
+        }
+
+        ++shift;
+
+        runParallel(info_block.height, thread_count, [&](int y)
+        {
+            if (linear)
+            {
+                transformSpan(pixels[y].data(), info_block.width, scales, offsets, shift);
+                return;
+            }
+
+            for (uint32_t& color : pixels[y]) {
+                color = (table.blue[(color >> 16) & 0xFF] << 16) | (table.green[(color >> 8) & 0xFF] << 8) | table.red[color & 0xFF];
+            }
+        });
+    }
+
+    /*  Метод, возвращающий полутоновую копию изображения (см. GrayImage) - по байту яркости на пиксель.
+        Строки обрабатываются SIMD-ядром lumaRow в thread_count потоках.  */
+    GrayImage toGrayImage(unsigned thread_count = 1) const
+    {
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        GrayImage result(*this, info_block.width, info_block.height);
+        runParallel(info_block.height, thread_count, [&](int y) { lumaRow(pixels[y].data(), info_block.width, result.row(y)); });
+
+        return result;
+    }
+
+    // Метод, позволяющий перевести изображение в оттенки серого на месте (каждый канал становится равным яркости).
+    void convertToGrayscale(unsigned thread_count = 1)
+    {
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        const int width = info_block.width, height = info_block.height;
+
+        // Строки делятся на полосы по 64 строки: буфер яркости выделяется один раз на полосу, а не на каждую строку.
+        const int band_height = 64;
+
+        runParallel((height + band_height - 1) / band_height, thread_count, [&](int band)
+        {
+            std::vector<uint8_t> luma(width);
+
+            for (int y = band * band_height; y < std::min((band + 1) * band_height, height); ++y)
+            {
+                lumaRow(pixels[y].data(), width, luma.data());
+                for (int x = 0; x < width; ++x) { pixels[y][x] = luma[x] * 0x01'0101u; }
+            }
+        });
+    }
+
+    /*  Метод, возвращающий порог яркости по методу Оцу: порог t, при котором разбиение пикселей на классы
+        "яркость <= t" и "яркость > t" дает наибольшую межклассовую дисперсию. Считается по гистограмме яркости
+        (см. histogram), поэтому изображение просматривается один раз.  */
+    int otsuThreshold(unsigned thread_count = 1) const
+    {
+        const std::array<uint64_t, 256>& counts = histogram(thread_count).luminance;
+
+        double total = 0.0, total_sum = 0.0;
+        for (int level = 0; level < 256; ++level)
+        {
+            total     += counts[level];
+            total_sum += static_cast<double>(level) * counts[level];
+        }
+
+        // Межклассовая дисперсия (с точностью до множителя): w0 * w1 * (m0 - m1)^2, где w - доли классов, m - средние.
+        int best_level = 0;
+        double best_variance = -1.0, below = 0.0, below_sum = 0.0;
+
+        for (int level = 0; level < 255; ++level)
+        {
+            below     += counts[level];
+            below_sum += static_cast<double>(level) * counts[level];
+
+            double above = total - below;
+            if (below == 0.0 || above == 0.0) { continue; }
+
+            double difference = below_sum / below - (total_sum - below_sum) / above;
+            double variance = below * above * difference * difference;
+
+            if (variance > best_variance)
+            {
+                best_variance = variance;
+                best_level = level;
+            }
+        }
+
+        return best_level;
+    }
+
+    /*  Метод, возвращающий двуцветное изображение (см. BinaryImage): белые пиксели - те, чья яркость больше level.
+        Каждая строка переводится в яркость (lumaRow) и сразу упаковывается в биты (thresholdRow),
+        так что промежуточных буферов во весь размер нет. Строки обрабатываются в thread_count потоках.  */
+    BinaryImage threshold(int level, unsigned thread_count = 1) const
+    {
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+        if (level < 0 || level > 255) {
+            throw std::runtime_error("Error! The threshold must be in the range from 0 to 255.");
+        }
+
+        const int width = info_block.width, height = info_block.height;
+        BinaryImage result(*this, width, height);
+
+        // Строки делятся на полосы по 64 строки, буфер яркости выделяется один раз на полосу (как в convertToGrayscale).
+        const int band_height = 64;
+
+        runParallel((height + band_height - 1) / band_height, thread_count, [&](int band)
+        {
+            std::vector<uint8_t> luma(width);
+
+            for (int y = band * band_height; y < std::min((band + 1) * band_height, height); ++y)
+            {
+                lumaRow(pixels[y].data(), width, luma.data());
+                thresholdRow(luma.data(), width, static_cast<uint8_t>(level), result.row(y));
+            }
+        });
+
+        return result;
+    }
+
+    // Метод, возвращающий двуцветное изображение с порогом, выбранным по методу Оцу (см. otsuThreshold).
+    BinaryImage thresholdOtsu(unsigned thread_count = 1) const
+    {
+        return threshold(otsuThreshold(thread_count), thread_count);
+    }
+
+    /*  Метод, возвращающий двуцветное изображение с локальным порогом: пиксель белый, если его яркость больше
+        среднего по окну (2 * radius + 1) x (2 * radius + 1) вокруг него минус offset (у границ окно обрезается).
+        Для ThresholdMethod::Gaussian среднее взвешенное: окно складывается из 4 вложенных квадратов, вес каждого
+        кольца равен значению гауссиана (sigma = radius / 2) на середине кольца. Любая сумма по квадрату берется
+        из таблицы сумм яркости за 4 обращения к памяти, поэтому время работы не зависит от радиуса.  */
+    BinaryImage thresholdAdaptive(int radius, int offset = 0, ThresholdMethod method = ThresholdMethod::Mean, unsigned thread_count = 1) const
+    {
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        // Сумма по окну должна помещаться в 32 бита (см. lumaSummedAreaTable).
+        if (radius < 1 || (2 * static_cast<uint64_t>(radius) + 1) * (2 * static_cast<uint64_t>(radius) + 1) > UINT32_MAX / 255) {
+            throw std::runtime_error("Error! The radius of the window must be in the range from 1 to 2051.");
+        }
+
+        const int width  = info_block.width;
+        const int height = info_block.height;
+
+        // 1. Яркость изображения и таблица сумм по ней.
+        GrayImage luma = toGrayImage(thread_count);
+        std::vector<uint32_t> table = lumaSummedAreaTable(luma, thread_count);
+        const size_t stride = static_cast<size_t>(width) + 1;
+
+        auto box_sum = [&](int x, int y, int half, uint32_t& area)
+        {
+            int x_begin = std::max(x - half, 0), x_end = std::min(x + half + 1, width);
+            int y_begin = std::max(y - half, 0), y_end = std::min(y + half + 1, height);
+
+            area = static_cast<uint32_t>((x_end - x_begin) * (y_end - y_begin));
+            return table[y_end * stride + x_end] - table[y_end * stride + x_begin] - table[y_begin * stride + x_end] + table[y_begin * stride + x_begin];
+        };
+
+        // 2. Для гауссова метода - полуширины вложенных квадратов и веса колец.
+        const int rings = 4;
+        int halves[rings];
+        double weights[rings];
+
+        for (int ring = 0; ring < rings; ++ring) { halves[ring] = std::max(1, static_cast<int>(std::lround(radius * (ring + 1) / static_cast<double>(rings)))); }
+
+        double sigma = radius / 2.0;
+        auto gauss = [&](double distance) { return std::exp(-distance * distance / (2.0 * sigma * sigma)); };
+
+        for (int ring = 0; ring < rings; ++ring)
+        {
+            double middle = ((ring == 0 ? 0 : halves[ring - 1]) + halves[ring]) / 2.0;
+            double next   = ring + 1 < rings ? (halves[ring] + halves[ring + 1]) / 2.0 : -1.0;
+
+            weights[ring] = gauss(middle) - (next < 0.0 ? 0.0 : gauss(next));
+        }
+
+        // 3. Сравниваю яркость каждого пикселя с локальным порогом и упаковываю результаты в биты.
+        BinaryImage result(*this, width, height);
+
+        runParallel(height, thread_count, [&](int y)
+        {
+            const uint8_t* source = luma.row(y);
+            uint8_t* bits = result.row(y);
+
+            for (int x = 0; x < width; ++x)
+            {
+                bool white;
+
+                if (method == ThresholdMethod::Mean)
+                {
+                    // Яркость > sum / area - offset  <=>  (яркость + offset) * area > sum.
+                    uint32_t area;
+                    uint32_t sum = box_sum(x, y, radius, area);
+                    white = (static_cast<int64_t>(source[x]) + offset) * area > static_cast<int64_t>(sum);
+                }
+                else
+                {
+                    double weighted_sum = 0.0, weighted_area = 0.0;
+
+                    for (int ring = 0; ring < rings; ++ring)
+                    {
+                        uint32_t area;
+                        weighted_sum  += weights[ring] * box_sum(x, y, halves[ring], area);
+                        weighted_area += weights[ring] * area;
+                    }
+
+                    white = source[x] + offset > weighted_sum / weighted_area;
+                }
+
+                if (x % 8 == 0) { bits[x / 8] = 0; }
+                bits[x / 8] |= white << (7 - x % 8);
+            }
+        });
+
+        return result;
+    }
+
+    /*  Метод, позволяющий выполнить глобальное выравнивание гистограммы: по гистограмме яркости (см. histogram)
+        строится таблица v -> 255 * (cdf(v) - cdf_min) / (N - cdf_min), где cdf - накопленная гистограмма,
+        и таблица применяется к каждому из трех каналов по отдельности (через applyLookupTable). Таблица
+        нелинейна, поэтому соотношения каналов, а значит оттенок и насыщенность цветов, могут заметно
+        измениться -> метод рассчитан прежде всего на серые и слабо окрашенные изображения.  */
+    void equalizeHistogram(unsigned thread_count = 1)
+    {
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        const std::array<uint64_t, 256> counts = histogram(thread_count).luminance;
+        uint64_t total = static_cast<uint64_t>(info_block.width) * info_block.height;
+
+        // Минимальное ненулевое значение накопленной гистограммы.
+        uint64_t minimum = 0;
+        for (int value = 0; value < 256 && minimum == 0; ++value) { minimum = counts[value]; }
+
+        if (minimum == total) { return; }
+
+        LookupTable table;
+        uint64_t cumulative = 0;
+
+        for (int value = 0; value < 256; ++value)
+        {
+            cumulative += counts[value];
+            table.blue[value] = static_cast<uint8_t>(cumulative <= minimum ? 0 : ((cumulative - minimum) * 255 + (total - minimum) / 2) / (total - minimum));
+        }
+
+        table.green = table.red = table.blue;
+        applyLookupTable(table, thread_count);
+    }
+
+    /*  Метод, позволяющий выполнить адаптивное выравнивание гистограммы с ограничением контраста (CLAHE).
+        Изображение делится на tiles_x x tiles_y плиток, и для каждой плитки (параллельно) строится гистограмма
+        яркости. Счетчики выше clip_limit * (средний счетчик) обрезаются, а излишек поровну распределяется по всем
+        значениям - это ограничивает усиление шума в однотонных областях. Таблица плитки - нормированная
+        накопленная гистограмма. Значение пикселя получается билинейной интерполяцией таблиц четырех ближайших
+        центров плиток (как и в equalizeHistogram, таблицы применяются к каждому каналу). Для каждой строки
+        таблицы двух соседних рядов плиток заранее смешиваются по вертикали, поэтому на канал пикселя
+        остается два обращения к таблицам и одна интерполяция по горизонтали.  */
+    void equalizeHistogramAdaptive(int tiles_x = 8, int tiles_y = 8, double clip_limit = 2.0, unsigned thread_count = 1)
+    {
+        // 1. Без считанного файла обрабатывать нечего.
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        const int width  = info_block.width;
+        const int height = info_block.height;
+
+        if (tiles_x <= 0 || tiles_y <= 0 || tiles_x > width || tiles_y > height) {
+            throw std::runtime_error("Error! The number of tiles must be positive and must not exceed the size of the image.");
+        }
+
+        if (!std::isfinite(clip_limit) || clip_limit < 1.0) {
+            throw std::runtime_error("Error! The clip limit must be a finite number of at least 1.");
+        }
+
+        // 2. Таблицы плиток: tables[ty * tiles_x + tx][v]. Плитка tx занимает столбцы [tx * width / tiles_x, (tx + 1) * width / tiles_x).
+        auto tile_begin = [](int tile, int tiles, int size) { return static_cast<int>(static_cast<int64_t>(size) * tile / tiles); };
+
+        std::vector<std::array<uint8_t, 256>> tables(tiles_x * tiles_y);
+
+        runParallel(tiles_x * tiles_y, thread_count, [&](int tile)
+        {
+            int tx = tile % tiles_x, ty = tile / tiles_x;
+            int x_begin = tile_begin(tx, tiles_x, width),  x_end = tile_begin(tx + 1, tiles_x, width);
+            int y_begin = tile_begin(ty, tiles_y, height), y_end = tile_begin(ty + 1, tiles_y, height);
+
+            // 2.1 Гистограмма яркости плитки.
+            std::array<uint64_t, 256> counts{};
+
+            for (int y = y_begin; y < y_end; ++y) {
+                for (int x = x_begin; x < x_end; ++x) { ++counts[luminance(pixels[y][x])]; }
+            }
+
+            // 2.2 Обрезаю счетчики и распределяю излишек: поровну на все значения, остаток - по одному на первые значения.
+            uint64_t area  = static_cast<uint64_t>(x_end - x_begin) * (y_end - y_begin);
+            // Порог больше площади плитки уже ничего не обрезает, а огромный clip_limit не поместился бы в uint64_t.
+            uint64_t limit = std::max<uint64_t>(1, static_cast<uint64_t>(std::min(clip_limit * area / 256.0, static_cast<double>(area))));
+            uint64_t excess = 0;
+
+            for (uint64_t& count : counts)
+            {
+                if (count > limit) { excess += count - limit; count = limit; }
+            }
+
+            for (int value = 0; value < 256; ++value) { counts[value] += excess / 256 + (static_cast<uint64_t>(value) < excess % 256 ? 1 : 0); }
+
+            // 2.3 Нормированная накопленная гистограмма.
+            uint64_t cumulative = 0;
+
+            for (int value = 0; value < 256; ++value)
+            {
+                cumulative += counts[value];
+                tables[tile][value] = static_cast<uint8_t>((cumulative * 255 + area / 2) / area);
+            }
+        });
+
+        /* 3.   Веса интерполяции по столбцам: столбец x лежит между центрами плиток left[x] и left[x] + 1
+                с весом правой плитки weight[x] (0..256). До первого центра и после последнего берется крайняя плитка.  */
+        auto interpolation = [](int position, int tiles, int size, int& first, int& weight)
+        {
+            double center = (position + 0.5) * tiles / size - 0.5;
+
+            if (center <= 0.0)       { first = 0;         weight = 0; return; }
+            if (center >= tiles - 1) { first = tiles - 1; weight = 0; return; }
+
+            first  = static_cast<int>(center);
+            weight = static_cast<int>(std::lround((center - first) * 256.0));
+        };
+
+        std::vector<int> left(width), weight_x(width);
+        for (int x = 0; x < width; ++x) { interpolation(x, tiles_x, width, left[x], weight_x[x]); }
+
+        // 4. Применяю таблицы (полосы строк обрабатываются параллельно).
+        const int band_height = 32;
+
+        runParallel((height + band_height - 1) / band_height, thread_count, [&](int band)
+        {
+            // Таблицы текущей строки, смешанные по вертикали: row_tables[tx][v] (значение * 256).
+            std::vector<std::array<uint16_t, 256>> row_tables(tiles_x);
+
+            for (int y = band * band_height; y < std::min((band + 1) * band_height, height); ++y)
+            {
+                int top, weight_y;
+                interpolation(y, tiles_y, height, top, weight_y);
+                int bottom = std::min(top + 1, tiles_y - 1);
+
+                for (int tx = 0; tx < tiles_x; ++tx)
+                {
+                    const std::array<uint8_t, 256>& upper = tables[top * tiles_x + tx];
+                    const std::array<uint8_t, 256>& lower = tables[bottom * tiles_x + tx];
+
+                    for (int value = 0; value < 256; ++value) { row_tables[tx][value] = static_cast<uint16_t>(upper[value] * (256 - weight_y) + lower[value] * weight_y); }
+                }
+
+                uint32_t* row = pixels[y].data();
+
+                for (int x = 0; x < width; ++x)
+                {
+                    const std::array<uint16_t, 256>& first  = row_tables[left[x]];
+                    const std::array<uint16_t, 256>& second = row_tables[std::min(left[x] + 1, tiles_x - 1)];
+                    uint32_t weight = weight_x[x], color = row[x], result = 0;
+
+                    for (int shift = 0; shift < 24; shift += 8)
+                    {
+                        uint32_t value = (color >> shift) & 0xFF;
+                        result |= ((first[value] * (256 - weight) + second[value] * weight + 32768) >> 16) << shift;
+                    }
+
+                    row[x] = result;
+                }
+            }
+        });
+    }
+
+    /*  Метод, позволяющий сразу считать BMP-файл в планарном виде (см. PlanarImage): каждая строка файла
+        раскладывается по плоскостям прямо при чтении, упакованные пиксели не создаются.  */
+    static PlanarImage readPlanar(const std::string& file_path, bool with_alpha = false)
+    {
+        // 1. Открываю файл и считываю заголовки (объект source хранит только их).
+        BMPImageEditor source;
+        std::ifstream inp_file = source.openFile(file_path);
+
+        const int width  = source.info_block.width;
+        const int height = source.info_block.height;
+        PlanarImage result(source, width, height, with_alpha);
+
+        // 2. Читаю строки (в файле они идут снизу вверх) и раскладываю их по плоскостям.
+        int row_size = ((width * 24 + 31) / 32) * 4;
+        std::vector<uint8_t> row_data(row_size);
+
+        for (int y = height - 1; y >= 0; --y)
+        {
+            inp_file.read(reinterpret_cast<char*>(row_data.data()), row_size);
+            if (inp_file.fail()) { throw std::runtime_error("Oops! An error occurred while reading the file."); }
+
+            decodePlanarRow(row_data.data(), width, result.row(PlanarImage::blue, y), result.row(PlanarImage::green, y), result.row(PlanarImage::red, y));
+        }
+
+        return result;
+    }
+
+    // Метод, возвращающий копию изображения в планарном виде (см. PlanarImage); строки раскладываются в thread_count потоках.
+    PlanarImage toPlanar(bool with_alpha = false, unsigned thread_count = 1) const
+    {
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        PlanarImage result(*this, info_block.width, info_block.height, with_alpha);
+
+        runParallel(info_block.height, thread_count, [&](int y) {
+            splitRow(pixels[y].data(), info_block.width, result.row(PlanarImage::blue, y), result.row(PlanarImage::green, y), result.row(PlanarImage::red, y));
+        });
+
+        return result;
+    }
+
+    /*  Метод, позволяющий заменить изображение изображением planar (размеры изображения при этом могут измениться,
+        а альфа-канал не используется). Метод можно вызывать и для объекта, в который еще ничего не считано.  */
+    void fromPlanar(const PlanarImage& planar, unsigned thread_count = 1)
+    {
+        file_header = planar.file_header;
+        info_block  = planar.info_block;
+        info_block.width  = planar.width();
+        info_block.height = planar.height();
+
+        pixels.assign(planar.height(), std::vector<uint32_t>(planar.width()));
+
+        runParallel(planar.height(), thread_count, [&](int y) {
+            mergeRow(planar.row(PlanarImage::blue, y), planar.row(PlanarImage::green, y), planar.row(PlanarImage::red, y), planar.width(), pixels[y].data());
+        });
+
+        fileWasRead = true;
+    }
+
+    /*  Метод, возвращающий изображение, переведенное в цветовое пространство space (см. ColorPlanes).
+        Строки переводятся SIMD-ядрами (см. rgbToHsv и соседние методы) в thread_count потоках.  */
+    ColorPlanes toColorSpace(ColorSpace space, unsigned thread_count = 1) const
+    {
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        const int width = info_block.width;
+        ColorPlanes result(space, width, info_block.height);
+
+        runParallel(info_block.height, thread_count, [&](int y) {
+            colorRowToSpace(space, pixels[y].data(), width, result.row(0, y), result.row(1, y), result.row(2, y));
+        });
+
+        return result;
+    }
+
+    // Метод, позволяющий заменить пиксели изображения пикселями из плоскостей planes (размеры должны совпадать с размерами изображения).
+    void fromColorSpace(const ColorPlanes& planes, unsigned thread_count = 1)
+    {
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+        if (planes.width() != static_cast<int>(info_block.width) || planes.height() != static_cast<int>(info_block.height)) {
+            throw std::runtime_error("Error! The size of the color planes does not match the size of the image.");
+        }
+
+        const int width = info_block.width, height = info_block.height;
+        const int band_height = 64;
+
+        runParallel((height + band_height - 1) / band_height, thread_count, [&](int band)
+        {
+            // Обратные ядра работают на месте, поэтому строки плоскостей копируются в рабочий буфер (один на полосу строк).
+            std::vector<float> buffer(3 * static_cast<size_t>(width));
+            float* first  = buffer.data();
+            float* second = first + width;
+            float* third  = second + width;
+
+            for (int y = band * band_height; y < std::min((band + 1) * band_height, height); ++y)
+            {
+                std::copy(planes.row(0, y), planes.row(0, y) + width, first);
+                std::copy(planes.row(1, y), planes.row(1, y) + width, second);
+                std::copy(planes.row(2, y), planes.row(2, y) + width, third);
+
+                colorRowFromSpace(planes.space(), first, second, third, width, pixels[y].data());
+            }
+        });
+    }
+
+    /*  Метод, позволяющий изменить изображение в цветовом пространстве space без промежуточных плоскостей
+        во весь размер: каждая строка переводится в space, передается в adjust(first, second, third, count)
+        (три массива компонент длины count, которые можно менять на месте) и сразу переводится обратно.
+        Строка при этом остается в кэше процессора. adjust вызывается из thread_count потоков одновременно.  */
+    template <typename Adjust>
+    void adjustInColorSpace(ColorSpace space, const Adjust& adjust, unsigned thread_count = 1)
+    {
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        const int width = info_block.width, height = info_block.height;
+        const int band_height = 64;
+
+        runParallel((height + band_height - 1) / band_height, thread_count, [&](int band)
+        {
+            // Рабочий буфер выделяется один раз на полосу из 64 строк.
+            std::vector<float> buffer(3 * static_cast<size_t>(width));
+            float* first  = buffer.data();
+            float* second = first + width;
+            float* third  = second + width;
+
+            for (int y = band * band_height; y < std::min((band + 1) * band_height, height); ++y)
+            {
+                colorRowToSpace(space, pixels[y].data(), width, first, second, third);
+                adjust(first, second, third, width);
+                colorRowFromSpace(space, first, second, third, width, pixels[y].data());
+            }
+        });
+    }
+
+    /*  Метод, позволяющий сдвинуть цветовой тон на hue_shift градусов и умножить насыщенность и значение (HSV)
+        на saturation_scale и value_scale (результаты ограничиваются диапазоном 0..1).  */
+    void adjustHSV(float hue_shift, float saturation_scale = 1.0f, float value_scale = 1.0f, unsigned thread_count = 1)
+    {
+        adjustInColorSpace(ColorSpace::HSV, [&](float* hue, float* saturation, float* value, int count)
+        {
+            for (int x = 0; x < count; ++x)
+            {
+                hue[x] += hue_shift;
+                saturation[x] = std::clamp(saturation[x] * saturation_scale, 0.0f, 1.0f);
+                value[x]      = std::clamp(value[x] * value_scale, 0.0f, 1.0f);
+            }
+        }, thread_count);
+    }
+
+    /*  Метод, позволяющий применить медианный фильтр с квадратным окном (2 * radius + 1) x (2 * radius + 1)
+        к каждому каналу (за границами изображения считаются продолженными крайние пиксели). Радиус - от 1 до 127.
+        Для радиусов 1 и 2 (окна 3x3 и 5x5) медиана выбирается сетью сравнений (см. medianNetwork): в SSE2-версии
+        _mm_min_epu8 и _mm_max_epu8 обрабатывают сразу 4 пикселя со всеми каналами. Для больших радиусов
+        используется метод Перро-Эбера с постоянным временем на пиксель (см. medianBandHistogram).
+        Строки делятся на полосы, которые обрабатываются в thread_count потоках.  */
+    void medianFilter(int radius, unsigned thread_count = 1)
+    {
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+        if (radius < 1 || radius > 127) {
+            throw std::runtime_error("Error! The radius of the median filter must be in the range from 1 to 127.");
+        }
+
+        const int height = info_block.height;
+        const int band_height = radius <= 2 ? 32 : 128;
+        std::vector<std::vector<uint32_t>> result(height, std::vector<uint32_t>(info_block.width, 0));
+
+        runParallel((height + band_height - 1) / band_height, thread_count, [&](int band)
+        {
+            int y_begin = band * band_height, y_end = std::min(y_begin + band_height, height);
+
+            if (radius <= 2) { medianBandNetwork(radius, y_begin, y_end, result); }
+            else { medianBandHistogram(radius, y_begin, y_end, result); }
+        });
+
+        pixels.swap(result);
+    }
+
+    /*  Метод, позволяющий выполнить морфологическую операцию над полутоновым изображением image с прямоугольным
+        структурным элементом (2 * radius_x + 1) x (2 * radius_y + 1). За границами изображения считается
+        нейтральное значение (255 для эрозии и 0 для дилатации), так что границы не "наползают" внутрь.
+        Проходы по строкам и по столбцам выполняются алгоритмом ван Херка - Гил-Вермана (см. vanHerkRow и vanHerkColumns):
+        три сравнения на пиксель независимо от размера элемента.  */
+    static void morphology(GrayImage& image, MorphologyOperation operation, int radius_x, int radius_y, unsigned thread_count = 1)
+    {
+        if (radius_x < 0 || radius_y < 0) {
+            throw std::runtime_error("Error! The radius of the structuring element can't be negative.");
+        }
+
+        auto pass = [&](bool dilate)
+        {
+            const uint8_t identity = dilate ? 0 : 255;
+
+            /* 1.   Проход по строкам (строки обрабатываются независимо). Строки делятся на полосы по 64 строки,
+                    и рабочая память vanHerkRow выделяется один раз на полосу.  */
+            if (radius_x > 0)
+            {
+                const int height = image.height(), band_height = 64;
+
+                runParallel((height + band_height - 1) / band_height, thread_count, [&](int band)
+                {
+                    std::vector<uint8_t> buffer;
+                    for (int y = band * band_height; y < std::min((band + 1) * band_height, height); ++y) {
+                        vanHerkRow(image.row(y), image.width(), radius_x, identity, dilate, buffer);
+                    }
+                });
+            }
+
+            // 2. Проход по столбцам: строки целиком обрабатываются SIMD-ядром combineBytes.
+            if (radius_y > 0)
+            {
+                vanHerkColumns<uint8_t>(image.row(0), image.stride(), image.width(), image.height(), radius_y, identity,
+                    [dilate](const uint8_t* a, const uint8_t* b, int count, uint8_t* result) { combineBytes(a, b, count, dilate, result); },
+                    thread_count);
+            }
+        };
+
+        switch (operation)
+        {
+            case MorphologyOperation::Erode:  pass(false); break;
+            case MorphologyOperation::Dilate: pass(true); break;
+            case MorphologyOperation::Open:   pass(false); pass(true); break;
+            case MorphologyOperation::Close:  pass(true); pass(false); break;
+        }
+    }
+
+    /*  Метод, позволяющий выполнить морфологическую операцию над двуцветным изображением image (см. morphology
+        для полутонового изображения). Строки переводятся в 64-битные слова (64 пикселя в слове, левый пиксель -
+        старший бит), и все операции выполняются над словами: по столбцам - алгоритмом ван Херка - Гил-Вермана
+        ("и" / "или" трех слов на 64 пикселя), а по строкам - сдвигами всей строки с удвоением длины окна
+        (окно длины 2s получается из окна длины s и его копии, сдвинутой на s), то есть за O(log(radius_x))
+        операций на слово.  */
+    static void morphology(BinaryImage& image, MorphologyOperation operation, int radius_x, int radius_y, unsigned thread_count = 1)
+    {
+        if (radius_x < 0 || radius_y < 0) {
+            throw std::runtime_error("Error! The radius of the structuring element can't be negative.");
+        }
+
+        const int width = image.width(), height = image.height();
+        const int words = (width + 63) / 64;
+
+        // 1. Перевожу строки в слова (байты строки идут в слове от старшего к младшему).
+        std::vector<uint64_t> data(static_cast<size_t>(words) * height, 0);
+
+        runParallel(height, thread_count, [&](int y)
+        {
+            const uint8_t* row = image.row(y);
+            uint64_t* target = data.data() + static_cast<size_t>(y) * words;
+
+            for (int i = 0; i < (width + 7) / 8; ++i) { target[i / 8] |= static_cast<uint64_t>(row[i]) << (56 - 8 * (i % 8)); }
+        });
+
+        auto pass = [&](bool dilate)
+        {
+            const uint64_t identity = dilate ? 0 : ~uint64_t(0);
+
+            // Строки - полосами по 64 строки, с одной рабочей памятью shiftWindowRow на полосу (как в morphology для GrayImage).
+            if (radius_x > 0)
+            {
+                const int band_height = 64;
+
+                runParallel((height + band_height - 1) / band_height, thread_count, [&](int band)
+                {
+                    std::vector<uint64_t> buffer;
+                    for (int y = band * band_height; y < std::min((band + 1) * band_height, height); ++y) {
+                        shiftWindowRow(data.data() + static_cast<size_t>(y) * words, width, radius_x, dilate, buffer);
+                    }
+                });
+            }
+
+            if (radius_y > 0)
+            {
+                vanHerkColumns<uint64_t>(data.data(), words, words, height, radius_y, identity,
+                    [dilate](const uint64_t* a, const uint64_t* b, int count, uint64_t* result) {
+                        for (int i = 0; i < count; ++i) { result[i] = dilate ? (a[i] | b[i]) : (a[i] & b[i]); }
+                    },
+                    thread_count);
+            }
+        };
+
+        switch (operation)
+        {
+            case MorphologyOperation::Erode:  pass(false); break;
+            case MorphologyOperation::Dilate: pass(true); break;
+            case MorphologyOperation::Open:   pass(false); pass(true); break;
+            case MorphologyOperation::Close:  pass(true); pass(false); break;
+        }
+
+        // 2. Перевожу слова обратно в байты строк (биты за правым краем изображения обнуляются).
+        runParallel(height, thread_count, [&](int y)
+        {
+            uint8_t* row = image.row(y);
+            const uint64_t* source = data.data() + static_cast<size_t>(y) * words;
+
+            for (int i = 0; i < (width + 7) / 8; ++i) { row[i] = static_cast<uint8_t>(source[i / 8] >> (56 - 8 * (i % 8))); }
+            if (width % 8 != 0) { row[width / 8] &= static_cast<uint8_t>(0xFF << (8 - width % 8)); }
+        });
+    }
+
+    /*  Метод, возвращающий карту границ - модуль градиента яркости (|gx| + |gy|), нормированный так, что резкий
+        перепад от 0 до 255 вдоль одной оси дает 255 (большие значения ограничиваются 255). Яркость каждой строки
+        считается по ходу дела (lumaRow), а градиент - одним SIMD-проходом по трем скользящим строкам (см. gradientRows),
+        так что промежуточных изображений нет. Строки делятся на полосы, которые обрабатываются в thread_count потоках.  */
+    GrayImage gradientMagnitude(GradientOperator gradient_operator = GradientOperator::Sobel, unsigned thread_count = 1) const
+    {
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        const int width = info_block.width, height = info_block.height;
+        const int shift = gradient_operator == GradientOperator::Sobel ? 2 : 4;
+        GrayImage result(*this, width, height);
+
+        runParallel((height + edge_band - 1) / edge_band, thread_count, [&](int band)
+        {
+            int y_begin = band * edge_band, y_end = std::min(y_begin + edge_band, height);
+
+            gradientRows(y_begin, y_end, width, height, gradient_operator,
+                [&](int y, uint8_t* target) { lumaRow(pixels[y].data(), width, target); },
+                [&](int y, const int16_t*, const int16_t*, const int16_t* magnitude)
+                {
+                    uint8_t* target = result.row(y);
+                    for (int x = 0; x < width; ++x) { target[x] = static_cast<uint8_t>(std::min(255, (magnitude[x] + (1 << (shift - 1))) >> shift)); }
+                });
+        });
+
+        return result;
+    }
+
+    /*  Метод, возвращающий карту границ по алгоритму Кэнни: 255 - граница, 0 - фон.
+        1. Яркость изображения размывается гауссовым фильтром с параметром sigma от 0 (размытия нет) до gaussian_sigma_limit.
+        2. Градиент считается оператором Собеля (см. gradientRows), его модуль нормирован как в gradientMagnitude.
+        3. Подавление немаксимумов: пиксель остается кандидатом, только если модуль градиента в нем не меньше,
+           чем у двух соседей вдоль направления градиента (направление округляется до 45 градусов сравнением |gy| и |gx|
+           с tg(22.5) и tg(67.5) в целых числах). Шаги 2 и 3 выполняются вместе, по полосам строк в thread_count потоках.
+        4. Гистерезис: кандидаты с модулем больше high становятся границами, а кандидаты с модулем больше low -
+           только если они (через других таких кандидатов) соединены с границей по 8 направлениям.  */
+    GrayImage canny(double low, double high, double sigma = 1.4, unsigned thread_count = 1) const
+    {
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+        // NaN не прошел бы проверки ниже и превратился бы в int с неопределенным результатом.
+        if (!std::isfinite(low) || !std::isfinite(high) || low < 0.0 || high < low) {
+            throw std::runtime_error("Error! The thresholds must be finite and must satisfy 0 <= low <= high.");
+        }
+        if (!std::isfinite(sigma) || sigma < 0.0 || sigma > gaussian_sigma_limit) {
+            throw std::runtime_error("Error! The sigma of the blur must be in the range [0, " + std::to_string(static_cast<int>(gaussian_sigma_limit)) + "].");
+        }
+
+        const int width = info_block.width, height = info_block.height;
+
+        // 1. Размытая яркость.
+        GrayImage luma = toGrayImage(thread_count);
+        if (sigma > 0.0) { blurGray(luma, sigma, thread_count); }
+
+        // Пороги в единицах модуля градиента Собеля (в 4 раза больше нормированного).
+        const int low_limit  = static_cast<int>(std::min(4.0 * low, 32767.0));
+        const int high_limit = static_cast<int>(std::min(4.0 * high, 32767.0));
+
+        // 2-3. Градиент и подавление немаксимумов: result получает метки 0 (фон), 1 (слабый кандидат), 2 (граница).
+        GrayImage result(*this, width, height);
+        const int padded = width + 2;
+
+        runParallel((height + edge_band - 1) / edge_band, thread_count, [&](int band)
+        {
+            int y_begin = band * edge_band, y_end = std::min(y_begin + edge_band, height);
+
+            /*  Три последние строки модуля градиента (дополненные нулями слева и справа) и производных;
+                строка y лежит в ячейке y % 3. Строки за границами изображения - нулевые.  */
+            std::vector<int16_t> magnitude(3 * static_cast<size_t>(padded), 0), gx(3 * static_cast<size_t>(width)), gy(3 * static_cast<size_t>(width));
+            std::vector<int16_t> zeros(padded, 0);
+
+            auto magnitude_row = [&](int y) { return y < 0 || y >= height ? zeros.data() + 1 : magnitude.data() + (y % 3) * padded + 1; };
+
+            auto suppress = [&](int y)
+            {
+                const int16_t *above = magnitude_row(y - 1), *row = magnitude_row(y), *below = magnitude_row(y + 1);
+                const int16_t *dx = gx.data() + (y % 3) * width, *dy = gy.data() + (y % 3) * width;
+                uint8_t* target = result.row(y);
+
+                for (int x = 0; x < width; ++x)
+                {
+                    int value = row[x];
+                    if (value <= low_limit) { target[x] = 0; continue; }
+
+                    // 13573 / 32768 = tg(22.5): градиент почти горизонтален, почти вертикален или диагонален.
+                    int ax = std::abs(dx[x]), ay = std::abs(dy[x]);
+                    int first, second;
+
+                    if (ay * 32768 <= ax * 13573) { first = row[x - 1]; second = row[x + 1]; }
+                    else if (ay * 13573 >= ax * 32768) { first = above[x]; second = below[x]; }
+                    else if ((dx[x] < 0) != (dy[x] < 0)) { first = above[x + 1]; second = below[x - 1]; }
+                    else { first = above[x - 1]; second = below[x + 1]; }
+
+                    target[x] = value > first && value >= second ? (value > high_limit ? 2 : 1) : 0;
+                }
+            };
+
+            // Строка y подавляется, когда готова строка y + 1 (поэтому градиент считается и на строку выше и ниже полосы).
+            gradientRows(std::max(y_begin - 1, 0), std::min(y_end + 1, height), width, height, GradientOperator::Sobel,
+                [&](int y, uint8_t* target) { std::copy(luma.row(y), luma.row(y) + width, target); },
+                [&](int y, const int16_t* dx, const int16_t* dy, const int16_t* value)
+                {
+                    std::copy(value, value + width, magnitude.data() + (y % 3) * padded + 1);
+                    std::copy(dx, dx + width, gx.data() + (y % 3) * width);
+                    std::copy(dy, dy + width, gy.data() + (y % 3) * width);
+
+                    if (y - 1 >= y_begin && y - 1 < y_end) { suppress(y - 1); }
+                });
+
+            if (y_end == height) { suppress(height - 1); }
+        });
+
+        // 4. Гистерезис: обход в глубину от границ по слабым кандидатам, затем метки переводятся в 0 и 255.
+        std::vector<std::pair<int, int>> stack;
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) { if (result.at(x, y) == 2) { stack.emplace_back(x, y); } }
+        }
+
+        while (!stack.empty())
+        {
+            auto [x, y] = stack.back();
+            stack.pop_back();
+
+            for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, height - 1); ++ny) {
+                for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, width - 1); ++nx)
+                {
+                    if (result.at(nx, ny) == 1)
+                    {
+                        result.at(nx, ny) = 2;
+                        stack.emplace_back(nx, ny);
+                    }
+                }
+            }
+        }
+
+        runParallel(height, thread_count, [&](int y)
+        {
+            uint8_t* row = result.row(y);
+            for (int x = 0; x < width; ++x) { row[x] = row[x] == 2 ? 255 : 0; }
+        });
+
+        return result;
+    }
+
+    /*  Метод, позволяющий размыть изображение квадратным окном со стороной 2 * radius + 1 (box blur),
+        повторив размытие passes раз (три прохода уже практически неотличимы от гауссова размытия).
+        За границами изображения считаются продолженными крайние пиксели. Каждый проход разделяется
+        на горизонтальный и вертикальный, и оба считаются скользящими суммами (одномерный вариант
+        таблицы сумм): при сдвиге окна прибавляется входящий пиксель и вычитается уходящий.
+        Поэтому стоимость не зависит от радиуса - около десятка операций на канал пикселя.  */
+    void boxBlur(int radius, int passes = 1, unsigned thread_count = 1)
+    {
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        if (radius < 0 || passes < 0) {
+            throw std::runtime_error("Error! The radius and the number of passes of the blur must not be negative.");
+        }
+
+        for (int pass = 0; pass < passes && radius > 0; ++pass) { boxBlurPass(radius, radius, thread_count); }
+    }
+
+    /*  Метод, позволяющий приближенно выполнить гауссово размытие с параметром sigma тремя проходами
+        box blur. Радиусы проходов подбираются так, чтобы дисперсия итогового размытия совпала с sigma^2
+        (метод P. Kovesi, "Fast Almost-Gaussian Filtering"). Стоимость не зависит от sigma (от 0 до blur_sigma_limit).  */
+    void approximateGaussianBlur(double sigma, unsigned thread_count = 1)
+    {
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        if (!std::isfinite(sigma) || sigma < 0.0 || sigma > blur_sigma_limit) {
+            throw std::runtime_error("Error! The sigma of the blur must be in the range [0, " + std::to_string(static_cast<int>(blur_sigma_limit)) + "].");
+        }
+
+        const int passes = 3;
+
+        // Идеальная ширина окна и две ближайшие нечетные ширины, между которыми распределяются проходы.
+        double ideal_width = std::sqrt(12.0 * sigma * sigma / passes + 1.0);
+        int lower_width = static_cast<int>(std::floor(ideal_width));
+        if (lower_width % 2 == 0) { --lower_width; }
+        int upper_width = lower_width + 2;
+
+        double ideal_lower = (12.0 * sigma * sigma - passes * lower_width * lower_width - 4.0 * passes * lower_width - 3.0 * passes)
+                           / (-4.0 * lower_width - 4.0);
+        int lower_count = static_cast<int>(std::lround(ideal_lower));
+
+        for (int pass = 0; pass < passes; ++pass)
+        {
+            int radius = ((pass < lower_count) ? lower_width : upper_width) / 2;
+            if (radius > 0) { boxBlurPass(radius, radius, thread_count); }
+        }
+    }
+
+    /*  Метод, позволяющий выполнить гауссово размытие с параметром sigma обычной (КИХ) сверткой:
+        строится сепарабельное ядро радиуса ceil(3 * sigma) (см. gaussianWeights), которое применяется через convolveSeparable.
+        Стоимость растет линейно с sigma, поэтому sigma ограничена gaussian_sigma_limit, а для больших sigma подходит recursiveGaussianBlur.  */
+    void gaussianBlur(double sigma, unsigned thread_count = 1)
+    {
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        if (!std::isfinite(sigma) || sigma <= 0.0 || sigma > gaussian_sigma_limit) {
+            throw std::runtime_error("Error! The sigma of the blur must be in the range (0, " + std::to_string(static_cast<int>(gaussian_sigma_limit)) + "].");
+        }
+
+        // Веса с фиксированной точкой точно представимы как float, поэтому convolveSeparable получит их без изменений.
+        const std::vector<int16_t> weights = gaussianWeights(sigma);
+        std::vector<float> kernel(weights.size());
+        for (size_t i = 0; i < weights.size(); ++i) { kernel[i] = static_cast<float>(weights[i]) / (1 << fixed_point_bits); }
+
+        convolveSeparable(kernel, kernel, thread_count);
+    }
+
+    /*  Метод, позволяющий выполнить гауссово размытие с параметром sigma (от 0.5 до gaussian_sigma_limit) рекурсивным
+        (БИХ) фильтром Янга - ван Влита. Каждый проход - это прямой и обратный рекурсивный фильтр третьего
+        порядка: около 8 умножений на канал пикселя, независимо от sigma. Вычисления идут в SIMD-регистрах
+        по 4 канала: горизонтальный проход обрабатывает сразу 4 строки, вертикальный - полосы по 16 столбцов
+        (строки полосы идут подряд в памяти, и все 64 канала полосы считаются одним циклом).  */
+    void recursiveGaussianBlur(double sigma, unsigned thread_count = 1)
+    {
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        if (!std::isfinite(sigma) || sigma < 0.5 || sigma > gaussian_sigma_limit) {
+            throw std::runtime_error("Error! The sigma of the recursive blur must be in the range [0.5, " + std::to_string(static_cast<int>(gaussian_sigma_limit)) + "].");
+        }
+
+        /* 1.   Коэффициенты фильтра (I. Young, L. van Vliet, "Recursive implementation of the Gaussian filter", 1995).
+                Прямой проход: w[n] = B * x[n] + c1 * w[n - 1] + c2 * w[n - 2] + c3 * w[n - 3],
+                обратный проход - та же формула в обратном направлении. Так как B + c1 + c2 + c3 = 1, шаг считается
+                как w[n - 1] + B * (x[n] - w[n - 1]) + c2 * (w[n - 2] - w[n - 1]) + c3 * (w[n - 3] - w[n - 1]):
+                в float округляются только малые разности, поэтому однотонные области не "уплывают" даже при большой sigma.  */
+        double q = (sigma >= 2.5) ? 0.98711 * sigma - 0.96330
+                                  : 3.97156 - 4.14554 * std::sqrt(1.0 - 0.26891 * sigma);
+
+        double b0 = 1.57825 + 2.44413 * q + 1.4281 * q * q + 0.422205 * q * q * q;
+        double b1 = 2.44413 * q + 2.85619 * q * q + 1.26661 * q * q * q;
+        double b2 = -(1.4281 * q * q + 1.26661 * q * q * q);
+        double b3 = 0.422205 * q * q * q;
+
+        const float c1 = static_cast<float>(b1 / b0);
+        const float c2 = static_cast<float>(b2 / b0);
+        const float c3 = static_cast<float>(b3 / b0);
+        const float B  = 1.0f - (c1 + c2 + c3);
+
+        const int width  = info_block.width;
+        const int height = info_block.height;
+
+        /* 1.1  Начальные значения обратного прохода (B. Triggs, M. Sdika, "Boundary conditions for Young - van Vliet
+                recursive filtering", 2006). Если за концом последовательности продолжается крайнее значение u,
+                то отклонения трех первых значений обратного прохода от u линейно зависят от отклонений трех
+                последних значений прямого прохода от u. Матрицу этой зависимости получаю численно: для каждого
+                из трех единичных отклонений "прокручиваю" оба прохода на участке, где отклик успевает затухнуть.  */
+        double boundary[3][3];
+        const int horizon = static_cast<int>(10.0 * sigma) + 64;
+
+        for (int j = 0; j < 3; ++j)
+        {
+            std::vector<double> forward(horizon + 6, 0.0), backward(horizon + 6, 0.0);
+            forward[2 - j] = 1.0;
+
+            for (int n = 3; n < horizon + 3; ++n) { forward[n] = c1 * forward[n - 1] + c2 * forward[n - 2] + c3 * forward[n - 3]; }
+            for (int n = horizon + 2; n >= 3; --n) { backward[n] = B * forward[n] + c1 * backward[n + 1] + c2 * backward[n + 2] + c3 * backward[n + 3]; }
+
+            for (int k = 0; k < 3; ++k) { boundary[k][j] = backward[3 + k]; }
+        }
+
+        /* 2.   Функтор, который фильтрует последовательность из count элементов по Lanes независимых каналов
+                в каждом. Данные лежат в буфере data с тремя дополнительными элементами с каждой стороны:
+                в них записываются крайние значения, и фильтр стартует из установившегося состояния
+                (как будто последовательность продолжена крайним значением). Число каналов - константа
+                времени компиляции, поэтому внутренний цикл по каналам компилятор векторизует.  */
+        auto filter = [&](auto lanes_constant, float* data, int count)
+        {
+            constexpr int Lanes = decltype(lanes_constant)::value;
+
+            // Один шаг фильтра для всех каналов элемента value (step = +Lanes -> прямой проход, -Lanes -> обратный).
+            auto filter_element = [=](float* value, int step)
+            {
+                int lane = 0;
+
+#if defined(__SSE2__)
+                const __m128 b  = _mm_set1_ps(B);
+                const __m128 k2 = _mm_set1_ps(c2);
+                const __m128 k3 = _mm_set1_ps(c3);
+
+                for (; lane + 4 <= Lanes; lane += 4)
+                {
+                    __m128 w1 = _mm_loadu_ps(value + lane - step);
+                    __m128 delta = _mm_mul_ps(b, _mm_sub_ps(_mm_loadu_ps(value + lane), w1));
+                    delta = _mm_add_ps(delta, _mm_mul_ps(k2, _mm_sub_ps(_mm_loadu_ps(value + lane - 2 * step), w1)));
+                    delta = _mm_add_ps(delta, _mm_mul_ps(k3, _mm_sub_ps(_mm_loadu_ps(value + lane - 3 * step), w1)));
+                    _mm_storeu_ps(value + lane, _mm_add_ps(w1, delta));
+                }
+#endif
+
+                for (; lane < Lanes; ++lane)
+                {
+                    float w1 = value[lane - step];
+                    value[lane] = w1 + (B * (value[lane] - w1) + c2 * (value[lane - 2 * step] - w1) + c3 * (value[lane - 3 * step] - w1));
+                }
+            };
+
+            // Прямой проход: w[n] = B * x[n] + c1 * w[n - 1] + c2 * w[n - 2] + c3 * w[n - 3].
+            float* last = data + static_cast<size_t>(count + 2) * Lanes;
+            float last_input[Lanes];
+            std::copy_n(last, Lanes, last_input);
+
+            for (int n = 0; n < 3; ++n) { std::copy_n(data + 3 * Lanes, Lanes, data + n * Lanes); }
+
+            for (int n = 3; n < count + 3; ++n) { filter_element(data + static_cast<size_t>(n) * Lanes, Lanes); }
+
+            // Обратный проход: та же формула, но соседи берутся справа. Начальные значения - см. пункт 1.1.
+            for (int lane = 0; lane < Lanes; ++lane)
+            {
+                float u = last_input[lane];
+                float d0 = last[lane] - u, d1 = last[lane - Lanes] - u, d2 = last[lane - 2 * Lanes] - u;
+
+                for (int k = 0; k < 3; ++k) {
+                    last[(k + 1) * Lanes + lane] = static_cast<float>(u + boundary[k][0] * d0 + boundary[k][1] * d1 + boundary[k][2] * d2);
+                }
+            }
+
+            for (int n = count + 2; n >= 3; --n) { filter_element(data + static_cast<size_t>(n) * Lanes, -Lanes); }
+        };
+
+        // Функторы, которые распаковывают пиксель в 4 числа с плавающей точкой и упаковывают обратно (с округлением).
+        auto to_channels = [](uint32_t color, float* channels)
+        {
+            for (int c = 0; c < 4; ++c) { channels[c] = static_cast<float>((color >> (8 * c)) & 0xFF); }
+        };
+
+        auto to_pixel = [](const float* channels)
+        {
+            uint32_t color = 0;
+            for (int c = 0; c < 3; ++c) { color |= static_cast<uint32_t>(std::clamp(channels[c] + 0.5f, 0.0f, 255.0f)) << (8 * c); }
+            return color;
+        };
+
+        /* 3.   Горизонтальный проход. Внутри строки каждый шаг зависит от предыдущего, поэтому
+                одновременно фильтруются 4 строки (16 каналов) - так задержки вычислений перекрываются.
+                Группы строк независимы и обрабатываются параллельно.  */
+        const int group = 4;
+        int group_count = (height + group - 1) / group;
+
+        runParallel(group_count, thread_count, [&](int index)
+        {
+            int y_begin = index * group;
+            int count = std::min(group, height - y_begin);
+
+            thread_local std::vector<float> buffer;
+            buffer.resize((static_cast<size_t>(width) + 6) * 4 * group);
+
+            for (int r = 0; r < group; ++r)
+            {
+                const uint32_t* row = pixels[y_begin + std::min(r, count - 1)].data();
+                for (int x = 0; x < width; ++x) { to_channels(row[x], &buffer[((x + 3) * group + r) * 4]); }
+            }
+
+            filter(std::integral_constant<int, 4 * group>(), buffer.data(), width);
+
+            for (int r = 0; r < count; ++r)
+            {
+                uint32_t* row = pixels[y_begin + r].data();
+                for (int x = 0; x < width; ++x) { row[x] = to_pixel(&buffer[((x + 3) * group + r) * 4]); }
+            }
+        });
+
+        /* 4.   Вертикальный проход: полосы по 16 столбцов (64 канала) обрабатываются параллельно.
+                В последней (неполной) полосе недостающие столбцы заполняются копией крайнего.  */
+        const int strip = 16;
+        int strip_count = (width + strip - 1) / strip;
+
+        runParallel(strip_count, thread_count, [&](int index)
+        {
+            int x_begin = index * strip;
+            int count = std::min(strip, width - x_begin);
+
+            std::vector<float> buffer((static_cast<size_t>(height) + 6) * 4 * strip);
+
+            for (int y = 0; y < height; ++y) {
+                for (int i = 0; i < strip; ++i) { to_channels(pixels[y][x_begin + std::min(i, count - 1)], &buffer[((y + 3) * strip + i) * 4]); }
+            }
+
+            filter(std::integral_constant<int, 4 * strip>(), buffer.data(), height);
+
+            for (int y = 0; y < height; ++y) {
+                for (int i = 0; i < count; ++i) { pixels[y][x_begin + i] = to_pixel(&buffer[((static_cast<size_t>(y) + 3) * strip + i) * 4]); }
+            }
+        });
+    }
+
+    /*  Метод, позволяющий повернуть или отразить изображение (см. Orientation). Отражения и поворот на 180
+        градусов выполняются на месте. При повороте на 90/270 градусов и транспонировании ширина и высота
+        меняются местами, поэтому результат собирается в новую матрицу: полосами по 32 строки и блоками
+        по 32 столбца, чтобы и читаемый, и записываемый блоки целиком помещались в кэш (наивное построчное
+        чтение столбцов промахивается мимо кэша на каждом пикселе). Полосы собираются в thread_count потоках.  */
+    void reorient(Orientation orientation, unsigned thread_count = 1)
+    {
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        const int width  = info_block.width;
+        const int height = info_block.height;
+
+        switch (orientation)
+        {
+            case Orientation::Normal:
+                return;
+
+            // 1. Отражения: строки разворачиваются на месте, а порядок строк меняется обменом указателей.
+            case Orientation::FlipHorizontal:
+            case Orientation::Rotate180:
+                runParallel(height, thread_count, [&](int y) { std::reverse(pixels[y].begin(), pixels[y].end()); });
+                if (orientation == Orientation::Rotate180) { std::reverse(pixels.begin(), pixels.end()); }
+                return;
+
+            case Orientation::FlipVertical:
+                std::reverse(pixels.begin(), pixels.end());
+                return;
+
+            // 2. Повороты на 90/270 градусов и транспонирования: новая матрица размера height x width.
+            default:
+            {
+                std::vector<std::vector<uint32_t>> result(width, std::vector<uint32_t>(height));
+
+                int band_count = (width + orientation_block - 1) / orientation_block;
+                runParallel(band_count, thread_count, [&](int band)
+                {
+                    int band_begin = band * orientation_block;
+                    int band_end   = std::min(band_begin + orientation_block, width);
+
+                    orientRows(orientation, band_begin, band_end, result.data() + band_begin);
+                });
+
+                pixels.swap(result);
+                std::swap(info_block.width, info_block.height);
+                std::swap(info_block.horizontal_resolution, info_block.vertical_resolution);
+                return;
+            }
+        }
+    }
+
+    /*  Метод, позволяющий повернуть изображение по часовой стрелке на угол, кратный 90 градусам
+        (отрицательный угол -> поворот против часовой стрелки).  */
+    void rotate(int degrees, unsigned thread_count = 1)
+    {
+        if (degrees % 90 != 0) {
+            throw std::runtime_error("Error! The rotation angle must be a multiple of 90 degrees.");
+        }
+
+        switch (((degrees / 90) % 4 + 4) % 4)
+        {
+            case 1:  reorient(Orientation::Rotate90, thread_count);  break;
+            case 2:  reorient(Orientation::Rotate180, thread_count); break;
+            case 3:  reorient(Orientation::Rotate270, thread_count); break;
+            default: reorient(Orientation::Normal, thread_count);    break;
+        }
+    }
+
+    // Метод, позволяющий отразить изображение слева направо.
+    void flipHorizontal(unsigned thread_count = 1) { reorient(Orientation::FlipHorizontal, thread_count); }
+
+    // Метод, позволяющий отразить изображение сверху вниз.
+    void flipVertical() { reorient(Orientation::FlipVertical); }
+
+    // Метод, позволяющий транспонировать изображение (отразить относительно главной диагонали).
+    void transpose(unsigned thread_count = 1) { reorient(Orientation::Transpose, thread_count); }
+
+    /*  Метод, возвращающий представление прямоугольника (x, y, width, height) изображения (см. ImageView):
+        с областью можно работать напрямую, не копируя ее в отдельное изображение.  */
+    ImageView view(int x, int y, int width, int height)
+    {
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        return ImageView(pixels.data(), 0, 0, info_block.width, info_block.height).subview(x, y, width, height);
+    }
+
+    /*  Метод, позволяющий обрезать изображение до прямоугольника (x, y, width, height) на месте:
+        лишние строки удаляются, а в оставшихся пиксели области сдвигаются к началу строки.  */
+    void crop(int x, int y, int width, int height)
+    {
+        // view проверяет, что файл считан и что прямоугольник лежит внутри изображения.
+        view(x, y, width, height);
+
+        for (int row = 0; row < height; ++row)
+        {
+            std::vector<uint32_t>& current = pixels[y + row];
+
+            /*  Пиксели области сдвигаются влево внутри той же строки. При x == 0 они уже на месте,
+                а std::copy не допускает совпадения начала приемника с началом источника.  */
+            if (x != 0) { std::copy(current.begin() + x, current.begin() + x + width, current.begin()); }
+            current.resize(width);
+            current.shrink_to_fit();
+        }
+
+        // Строки области сдвигаются обменом векторов (без копирования пикселей).
+        for (int row = 0; row < height; ++row) { pixels[row].swap(pixels[y + row]); }
+        pixels.resize(height);
+
+        info_block.width  = width;
+        info_block.height = height;
+    }
+
+    /*  Метод, позволяющий изменить размер изображения до new_width x new_height с фильтром filter.
+        Ресемплинг сепарабельный: таблицы весов для столбцов и строк строятся один раз (при уменьшении фильтр
+        растягивается в source / target раз, чтобы не было алиасинга), затем каждая исходная строка сжимается
+        по горизонтали в 16-битный промежуточный буфер, а каждая выходная строка собирается из строк буфера
+        тем же SIMD-ядром, что и вертикальный проход свертки. Оба прохода делятся на полосы строк
+        и выполняются в thread_count потоках.  */
+    void resize(int new_width, int new_height, ResampleFilter filter = ResampleFilter::Bicubic, unsigned thread_count = 1)
+    {
+        // 1. Без считанного файла обрабатывать нечего.
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        if (new_width <= 0 || new_height <= 0) {
+            throw std::runtime_error("Error! The size of the image must be positive.");
+        }
+
+        const int width  = info_block.width;
+        const int height = info_block.height;
+
+        // 2. Таблицы весов для столбцов и строк результата.
+        ResampleTable columns = makeResampleTable(width, new_width, filter);
+        ResampleTable rows    = makeResampleTable(height, new_height, filter);
+
+        /* 3.   Горизонтальный проход: каждая исходная строка сжимается до new_width пикселей. Результат хранится
+                в 16-битном формате с 4 дробными битами (как промежуточные строки convolveSeparable).  */
+        const int intermediate_bits = 4;
+        const int band_height = 32;
+        const size_t stride = 4 * static_cast<size_t>(new_width);
+
+        std::vector<int16_t> intermediate(stride * height);
+
+        runParallel((height + band_height - 1) / band_height, thread_count, [&](int band)
+        {
+            std::vector<int32_t> sums(stride);
+
+            for (int y = band * band_height; y < std::min((band + 1) * band_height, height); ++y)
+            {
+                resampleRow(pixels[y].data(), columns, new_width, sums.data());
+                packSums(sums.data(), static_cast<int>(stride), fixed_point_bits - intermediate_bits, intermediate.data() + stride * y);
+            }
+        });
+
+        // 4. Вертикальный проход: выходная строка - взвешенная сумма rows.taps строк промежуточного буфера.
+        std::vector<std::vector<uint32_t>> result(new_height, std::vector<uint32_t>(new_width));
+
+        runParallel((new_height + band_height - 1) / band_height, thread_count, [&](int band)
+        {
+            std::vector<int32_t> sums(stride);
+            std::vector<const int16_t*> sources(rows.taps);
+
+            for (int y = band * band_height; y < std::min((band + 1) * band_height, new_height); ++y)
+            {
+                for (int k = 0; k < rows.taps; ++k) { sources[k] = intermediate.data() + stride * (rows.starts[y] + k); }
+
+                weightedSum(sources.data(), rows.weights.data() + static_cast<size_t>(y) * rows.taps, rows.taps, static_cast<int>(stride), sums.data());
+                packPixels(sums.data(), new_width, fixed_point_bits + intermediate_bits, result[y].data());
+            }
+        });
+
+        // 5. Заменяю изображение результатом.
+        pixels.swap(result);
+        info_block.width  = new_width;
+        info_block.height = new_height;
+    }
+
+    /*  Метод, позволяющий применить к изображению аффинное преобразование: точка (x, y) исходного изображения
+        переходит в точку (matrix[0] * x + matrix[1] * y + matrix[2], matrix[3] * x + matrix[4] * y + matrix[5])
+        результата размера new_width x new_height. Пиксели, которые не покрыты исходным изображением,
+        закрашиваются BGR-цветом фона. Для каждого пикселя результата обратным преобразованием находится точка
+        исходного изображения, цвет в которой получается билинейной интерполяцией. Координаты этой точки
+        вдоль строки меняются на постоянный шаг, поэтому они ведутся в формате с фиксированной точкой
+        (16 дробных бит) одним сложением на пиксель. Результат обрабатывается блоками 64 x 64 пикселя
+        (так нужный участок исходного изображения помещается в кэш даже при повороте), полосы блоков
+        выполняются в thread_count потоках.  */
+    void warpAffine(const std::vector<double>& matrix, int new_width, int new_height,
+                    uint8_t blue = 0, uint8_t green = 0, uint8_t red = 0, unsigned thread_count = 1)
+    {
+        // 1. Без считанного файла обрабатывать нечего.
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        if (matrix.size() != 6) {
+            throw std::runtime_error("Error! The affine transformation must be given by 6 coefficients.");
+        }
+
+        if (new_width <= 0 || new_height <= 0) {
+            throw std::runtime_error("Error! The size of the image must be positive.");
+        }
+
+        /* 2.   Обращаю преобразование. Центр пикселя результата (x + 0.5, y + 0.5) переходит в точку исходного
+                изображения, из которой вычитаю 0.5 - так целая часть координаты - это индекс левого (верхнего)
+                пикселя для интерполяции.  */
+        double determinant = matrix[0] * matrix[4] - matrix[1] * matrix[3];
+
+        if (std::fabs(determinant) < 1e-12) {
+            throw std::runtime_error("Error! The affine transformation must be invertible.");
+        }
+
+        double a = matrix[4] / determinant,  b = -matrix[1] / determinant;
+        double c = -matrix[3] / determinant, d = matrix[0] / determinant;
+        double e = -(a * matrix[2] + b * matrix[5]), f = -(c * matrix[2] + d * matrix[5]);
+
+        auto source_x = [&](double x, double y) { return a * (x + 0.5) + b * (y + 0.5) + e - 0.5; };
+        auto source_y = [&](double x, double y) { return c * (x + 0.5) + d * (y + 0.5) + f - 0.5; };
+
+        const double one = 65536.0;
+        const int64_t step_x = std::llround(a * one), step_y = std::llround(c * one);
+
+        const int width  = info_block.width;
+        const int height = info_block.height;
+        const int64_t limit_x = static_cast<int64_t>(width - 1) << 16;
+        const int64_t limit_y = static_cast<int64_t>(height - 1) << 16;
+        const uint32_t background = (blue << 16) | (green << 8) | red;
+
+        // 3. Пиксель исходного изображения (или фон за его границами).
+        auto fetch = [&](int64_t x, int64_t y) { return (x < 0 || y < 0 || x >= width || y >= height) ? background : pixels[y][x]; };
+
+        // Цвет в точке (x, y) (координаты в формате с фиксированной точкой), границы проверяются для каждого пикселя.
+        auto sample_checked = [&](int64_t x, int64_t y)
+        {
+            int64_t left = x >> 16, top = y >> 16;
+            if (left < -1 || top < -1 || left >= width || top >= height) { return background; }
+
+            uint32_t fraction_x = (x >> 8) & 0xFF, fraction_y = (y >> 8) & 0xFF;
+
+            return lerpColors(lerpColors(fetch(left, top), fetch(left + 1, top), fraction_x),
+                              lerpColors(fetch(left, top + 1), fetch(left + 1, top + 1), fraction_x), fraction_y);
+        };
+
+        const int block = 64;
+        std::vector<std::vector<uint32_t>> result(new_height, std::vector<uint32_t>(new_width));
+
+        runParallel((new_height + block - 1) / block, thread_count, [&](int band)
+        {
+            int band_begin = band * block;
+            int band_end   = std::min(band_begin + block, new_height);
+
+            /* 4.   Для каждой строки полосы нахожу отрезок [inner_begin, inner_end), на котором все четыре пикселя
+                    интерполяции лежат внутри изображения - там проверки границ не нужны. Координаты пикселя x строки
+                    всегда считаются как start + x * step (с одним и тем же start), поэтому условие 0 <= start + x * step < limit
+                    линейно по x, поэтому сначала беру приближенные границы, а затем уточняю их точной проверкой.  */
+            std::vector<int> inner_begin(band_end - band_begin), inner_end(band_end - band_begin);
+            std::vector<int64_t> row_x(band_end - band_begin), row_y(band_end - band_begin);
+
+            for (int y = band_begin; y < band_end; ++y)
+            {
+                int64_t start_x = row_x[y - band_begin] = std::llround(source_x(0, y) * one);
+                int64_t start_y = row_y[y - band_begin] = std::llround(source_y(0, y) * one);
+
+                auto inside = [&](int x) {
+                    int64_t sx = start_x + x * step_x, sy = start_y + x * step_y;
+                    return sx >= 0 && sx < limit_x && sy >= 0 && sy < limit_y;
+                };
+
+                int begin = 0, end = new_width;
+                for (auto [start, step, limit] : { std::make_tuple(start_x, step_x, limit_x), std::make_tuple(start_y, step_y, limit_y) })
+                {
+                    if (step == 0) { continue; }
+
+                    double first = -static_cast<double>(start) / step, second = static_cast<double>(limit - start) / step;
+                    begin = static_cast<int>(std::clamp<double>(std::floor(std::min(first, second)) - 1.0, begin, end));
+                    end   = static_cast<int>(std::clamp<double>(std::ceil(std::max(first, second)) + 1.0, begin, end));
+                }
+
+                while (begin < end && !inside(begin)) { ++begin; }
+                while (end > begin && !inside(end - 1)) { --end; }
+
+                inner_begin[y - band_begin] = begin;
+                inner_end[y - band_begin]   = end;
+            }
+
+            // 5. Обхожу полосу блоками по 64 столбца, внутри блока - по строкам.
+            for (int block_begin = 0; block_begin < new_width; block_begin += block)
+            {
+                int block_end = std::min(block_begin + block, new_width);
+
+                for (int y = band_begin; y < band_end; ++y)
+                {
+                    uint32_t* output = result[y].data();
+                    int64_t sx = row_x[y - band_begin] + block_begin * step_x;
+                    int64_t sy = row_y[y - band_begin] + block_begin * step_y;
+
+                    int fast_begin = std::clamp(inner_begin[y - band_begin], block_begin, block_end);
+                    int fast_end   = std::clamp(inner_end[y - band_begin], fast_begin, block_end);
+                    int x = block_begin;
+
+                    for (; x < fast_begin; ++x, sx += step_x, sy += step_y) { output[x] = sample_checked(sx, sy); }
+
+                    for (; x < fast_end; ++x, sx += step_x, sy += step_y)
+                    {
+                        const uint32_t* upper = pixels[sy >> 16].data() + (sx >> 16);
+                        const uint32_t* lower = pixels[(sy >> 16) + 1].data() + (sx >> 16);
+                        uint32_t fraction_x = (sx >> 8) & 0xFF, fraction_y = (sy >> 8) & 0xFF;
+
+                        output[x] = lerpColors(lerpColors(upper[0], upper[1], fraction_x), lerpColors(lower[0], lower[1], fraction_x), fraction_y);
+                    }
+
+                    for (; x < block_end; ++x, sx += step_x, sy += step_y) { output[x] = sample_checked(sx, sy); }
+                }
+            }
+        });
+
+        // 6. Заменяю изображение результатом.
+        pixels.swap(result);
+        info_block.width  = new_width;
+        info_block.height = new_height;
+    }
+
+    /*  Метод, позволяющий повернуть изображение на произвольный угол degrees по часовой стрелке вокруг центра
+        (например, для выравнивания отсканированных документов). Если expand = true, то размер результата
+        увеличивается так, чтобы повернутое изображение поместилось целиком, иначе размер не меняется.
+        Углы открывшихся областей закрашиваются BGR-цветом фона (см. warpAffine).  */
+    void rotateByAngle(double degrees, bool expand = true, uint8_t blue = 0, uint8_t green = 0, uint8_t red = 0, unsigned thread_count = 1)
+    {
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        const double pi = 3.14159265358979323846;
+        double angle = degrees * pi / 180.0;
+        double cosine = std::cos(angle), sine = std::sin(angle);
+
+        // Ось y направлена вниз, поэтому обычная матрица поворота поворачивает изображение по часовой стрелке.
+        int width  = info_block.width;
+        int height = info_block.height;
+        int new_width  = width;
+        int new_height = height;
+
+        if (expand)
+        {
+            new_width  = std::max(1, static_cast<int>(std::ceil(std::fabs(width * cosine) + std::fabs(height * sine) - 1e-6)));
+            new_height = std::max(1, static_cast<int>(std::ceil(std::fabs(width * sine) + std::fabs(height * cosine) - 1e-6)));
+        }
+
+        // Центр исходного изображения переходит в центр результата.
+        double center_x = width / 2.0, center_y = height / 2.0;
+        double new_center_x = new_width / 2.0, new_center_y = new_height / 2.0;
+
+        warpAffine({ cosine, -sine, new_center_x - cosine * center_x + sine * center_y,
+                     sine, cosine, new_center_y - sine * center_x - cosine * center_y },
+                   new_width, new_height, blue, green, red, thread_count);
+    }
+
+    /*  Метод, позволяющий построить пирамиду уменьшенных копий изображения (mipmap): элемент 0 - изображение
+        вдвое меньше исходного, элемент 1 - вчетверо меньше и т.д. до размера 1 x 1 (размер уровня - половина
+        предыдущего с округлением вниз, но не меньше 1). Все уровни строятся за один проход по строкам
+        исходного изображения: как только у уровня готовы две новые строки, из них сразу получается строка
+        следующего уровня, поэтому каждая строка читается, пока она еще в кэше, а дополнительная память
+        нужна только под сами уровни.  */
+    std::vector<BMPImageEditor> buildPyramid() const
+    {
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        // 1. Создаю уровни нужных размеров (заголовки копируются из исходного изображения).
+        std::vector<BMPImageEditor> levels;
+        int width  = info_block.width;
+        int height = info_block.height;
+
+        while (width > 1 || height > 1)
+        {
+            width  = std::max(width / 2, 1);
+            height = std::max(height / 2, 1);
+
+            BMPImageEditor level;
+            level.file_header = file_header;
+            level.info_block  = info_block;
+            level.info_block.width  = width;
+            level.info_block.height = height;
+            level.pixels.assign(height, std::vector<uint32_t>(width));
+            level.fileWasRead = true;
+
+            levels.push_back(std::move(level));
+        }
+
+        /* 2.   Прохожу по строкам исходного изображения. Готовая строка y уровня level (0 - исходное изображение)
+                "спускается" вниз по пирамиде: если это вторая строка пары (или у уровня всего одна строка),
+                то из пары получается строка y / 2 следующего уровня, и проверка повторяется уже для нее.  */
+        for (int source_y = 0; source_y < static_cast<int>(info_block.height); ++source_y)
+        {
+            int y = source_y;
+
+            for (size_t level = 0; level < levels.size(); ++level)
+            {
+                const std::vector<std::vector<uint32_t>>& source = (level == 0) ? pixels : levels[level - 1].pixels;
+                int source_height = source.size();
+                int target_height = levels[level].info_block.height;
+                int target_y;
+
+                if (source_height == 1)                          { target_y = 0; }
+                else if (y % 2 == 1 && y / 2 < target_height)    { target_y = y / 2; }
+                else                                             { break; }
+
+                downsampleRows(source[2 * target_y].data(), source[std::min(2 * target_y + 1, source_height - 1)].data(),
+                               source[0].size(), levels[level].info_block.width, levels[level].pixels[target_y].data());
+
+                y = target_y;
+            }
+        }
+
+        return levels;
+    }
+
+    /*  Метод, позволяющий разрезать BMP-файл source_path на квадратные плитки размера tile_size для всех уровней
+        масштаба (раскладка как в Deep Zoom): уровень 0 - изображение 1 x 1, каждый следующий вдвое больше
+        (с округлением вверх), последний - исходное изображение. Плитка столбца column и строки row уровня level
+        записывается в файл directory/level/column_row.bmp (крайние плитки могут быть меньше tile_size).
+        Изображение целиком в память не загружается: файл читается построчно (снизу вверх, как строки лежат
+        в файле), каждая строка сразу "спускается" на более мелкие уровни (как в buildPyramid), а каждый уровень
+        хранит только текущую полосу из tile_size строк. Как только полоса заполнена, ее плитки записываются
+        в thread_count потоках. Памяти нужно примерно 2 * tile_size строк исходного изображения.  */
+    static void exportTiles(const std::string& source_path, const std::string& directory, int tile_size = 256, unsigned thread_count = 1)
+    {
+        if (tile_size <= 0) {
+            throw std::runtime_error("Error! The size of the tile must be positive.");
+        }
+
+        // 1. Открываю исходный файл и считываю заголовки (объект source хранит только их).
+        BMPImageEditor source;
+        std::ifstream inp_file = source.openFile(source_path);
+
+        const int width  = source.info_block.width;
+        const int height = source.info_block.height;
+
+        /* 2.   Описываю уровни: levels[level] - уровень с номером level (последний - исходное изображение).
+                У каждого уровня есть полоса из tile_size строк: строка y хранится в band[y % tile_size].  */
+        struct Level
+        {
+            int width, height;
+            std::vector<std::vector<uint32_t>> band;
+        };
+
+        std::vector<Level> levels;
+        for (int level_width = width, level_height = height; ; level_width = (level_width + 1) / 2, level_height = (level_height + 1) / 2)
+        {
+            levels.push_back({ level_width, level_height, std::vector<std::vector<uint32_t>>(std::min(tile_size, level_height), std::vector<uint32_t>(level_width)) });
+            if (level_width == 1 && level_height == 1) { break; }
+        }
+
+        std::reverse(levels.begin(), levels.end());
+
+        for (size_t level = 0; level < levels.size(); ++level) { std::filesystem::create_directories(directory + "/" + std::to_string(level)); }
+
+        /* 3.   Функтор, который записывает все плитки полосы, начинающейся со строки band_top уровня level.
+                Если плитку записать не удалось, runParallel пробросит исключение writeFile из любого потока.  */
+        auto write_band = [&](int level, int band_top)
+        {
+            const Level& current = levels[level];
+            int band_height = std::min(tile_size, current.height - band_top);
+            int columns = (current.width + tile_size - 1) / tile_size;
+
+            runParallel(columns, thread_count, [&](int column)
+            {
+                int tile_left  = column * tile_size;
+                int tile_width = std::min(tile_size, current.width - tile_left);
+
+                std::vector<const uint32_t*> rows(band_height);
+                for (int y = 0; y < band_height; ++y) { rows[y] = current.band[y].data() + tile_left; }
+
+                source.writeFile(directory + "/" + std::to_string(level) + "/" + std::to_string(column) + "_" + std::to_string(band_top / tile_size) + ".bmp",
+                                 rows.data(), tile_width, band_height);
+            });
+        };
+
+        // 4. Читаю строки исходного изображения (в файле они идут снизу вверх).
+        int row_size = ((width * 24 + 31) / 32) * 4;
+        std::vector<uint8_t> row_data(row_size);
+
+        for (int source_y = height - 1; source_y >= 0; --source_y)
+        {
+            inp_file.read(reinterpret_cast<char*>(row_data.data()), row_size);
+            if (inp_file.fail()) { throw std::runtime_error("Oops! An error occurred while reading the file."); }
+
+            decodeRow(row_data.data(), width, levels.back().band[source_y % tile_size].data());
+
+            /* 4.1  Строка y уровня level готова. Четная строка завершает пару (y, y + 1) - нечетная строка y + 1
+                    пришла раньше, а у последней строки при нечетной высоте пары нет - и из пары получается строка
+                    y / 2 более мелкого уровня. Когда готова верхняя строка полосы, записываю плитки полосы.  */
+            int y = source_y;
+
+            for (int level = static_cast<int>(levels.size()) - 1; level >= 0; --level)
+            {
+                Level& current = levels[level];
+
+                if (y % 2 == 0 && level > 0)
+                {
+                    Level& next = levels[level - 1];
+                    downsampleRows(current.band[y % tile_size].data(), current.band[std::min(y + 1, current.height - 1) % tile_size].data(),
+                                   current.width, next.width, next.band[(y / 2) % tile_size].data());
+                }
+
+                if (y % tile_size == 0) { write_band(level, y); }
+
+                if (y % 2 != 0 || level == 0) { break; }
+                y /= 2;
+            }
+        }
+    }
+
+    /*  Метод, позволяющий сохранить изображение в некоторый файл. Параметр orientation позволяет сразу
+        записать повернутое или отраженное изображение: строки результата собираются прямо во время записи
+        полосами по 32 строки (см. reorient), поэтому вторая копия изображения в памяти не создается.  */
+    void save(const std::string& file_path, Orientation orientation = Orientation::Normal)
+    {
+        // 1. Без считанного файла сохранять нечего.
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        // 2. Создаю выходной поток для записи в некоторый файл.
+        std::ofstream out_file(file_path, std::ios::out | std::ios::trunc | std::ios::binary);
+
+        if (!out_file) {
+            throw std::runtime_error("Error! It's not possible to open the file on the path: \"" + file_path + "\".");
+        }
+
+        // 3. Определяю размеры результата (при повороте на 90/270 градусов ширина и высота меняются местами).
+        bool transposed = isTransposing(orientation);
+        int width  = transposed ? info_block.height : info_block.width;
+        int height = transposed ? info_block.width : info_block.height;
+
+        // 4. Выравниваю строку по 4 байта.
+        int32_t row_stride = ((width * 24 + 31) / 32) * 4;
+
+        /* 5.   Записываю в файл информацию о первых двух блоках. Размеры в заголовках пересчитываются,
+                ведь изображение могло измениться (например, после поворота).  */
+        BMPFileHeader header;
+        BMPFileInfoBlock info;
+        makeHeaders(file_header, info_block, width, height, 24, 0, header, info);
+
+        // Вместе с размерами меняются местами и разрешения (как в reorient) - иначе неквадратный пиксель "повернется" неверно.
+        if (transposed) { std::swap(info.horizontal_resolution, info.vertical_resolution); }
+
+        out_file.write(reinterpret_cast<char*>(&header), sizeof(BMPFileHeader));
+        out_file.write(reinterpret_cast<char*>(&info), sizeof(BMPFileInfoBlock));
+
+        /* 6.   В BMP-файле строки располагаются в обратном порядке (снизу вверх). Строки результата
+                собираются полосами (снизу вверх), а затем каждая строка кодируется в байты.  */
+        std::vector<std::vector<uint32_t>> band(orientation_block, std::vector<uint32_t>(width));
+        std::vector<uint8_t> row_data(row_stride, 0);
+
+        for (int band_end = height; band_end > 0; band_end -= orientation_block)
+        {
+            int band_begin = std::max(band_end - orientation_block, 0);
+            orientRows(orientation, band_begin, band_end, band.data());
+
+            for (int y = band_end - 1; y >= band_begin; --y)
+            {
+                // Избегаю потери качества при сохранении изображения (см. encodeRow)!
+                encodeRow(band[y - band_begin].data(), width, row_data.data());
+
+                // 7. Записываю полученную строку (вместе с нулевым выравниванием) в выходной файл.
+                out_file.write(reinterpret_cast<char*>(row_data.data()), row_data.size());
+            }
+        }
+
+        // 8. Закрываю выходной поток (ошибка записи, например нехватка места на диске, проявится именно здесь).
+        out_file.close();
+        if (out_file.fail()) { throw std::runtime_error("Oops! An error occurred while writing the file \"" + file_path + "\"."); }
+    }
+
+    /*  Метод, позволяющий сохранить в файл только область region этого изображения (см. view):
+        строки области записываются прямо из изображения, без промежуточной копии.  */
+    void save(const std::string& file_path, const ImageView& region) const
+    {
+        if (!fileWasRead) {
+            throw std::runtime_error("Error! First you need to read the data from the file.");
+        }
+
+        std::vector<const uint32_t*> rows(region.height());
+        for (int y = 0; y < region.height(); ++y) { rows[y] = region.row(y); }
+
+        writeFile(file_path, rows.data(), region.width(), region.height());
+    }
+
+    // Метод, позволяющий вывести изображение в консоль.
+    void printImage() const
+    {
+        for (int y = 0; y < info_block.height; ++y)
+        {
+            for (int x = 0; x < info_block.width; ++x)
+            {
+                // Если пиксель черный:
+                if (pixels[y][x] == 0x00'00'00) { std::cout << black; }
+
+                // Если пиксель белый:
+                else if (pixels[y][x] == 0xFF'FF'FF) { std::cout << white; }
+
+                // Если пиксель неизвестного мне цвета:
+                else { std::cout << unknown_color; }
+            }
+
+            std::cout << '\n';
+        }
+    }
+
+private:
+    /*  Ниже находятся вспомогательные методы растеризации. Каждый из них рисует примитив только
+        в строках [row_begin, row_end) -> так один и тот же код используется и для одиночной
+        отрисовки (диапазон = все изображение), и для пакетной отрисовки по полосам.  */
+
+    /*  Вспомогательный метод, который выполняет task(i) для всех i из [0, task_count) в нескольких потоках.
+        Если какая-то задача бросила исключение, новые задачи больше не выдаются, а первое исключение
+        пробрасывается вызывающему коду после того, как все потоки завершатся.  */
+    static void runParallel(int task_count, unsigned thread_count, const std::function<void(int)>& task)
+    {
+        if (thread_count == 0) { thread_count = std::max(1u, std::thread::hardware_concurrency()); }
+        thread_count = std::min<unsigned>(thread_count, std::max(task_count, 1));
+
+        // Потоки по очереди забирают номера задач из общего атомарного счетчика.
+        std::atomic<int> next_task{ 0 };
+        std::atomic<bool> failed{ false };
+        std::exception_ptr error;
+        std::mutex error_mutex;
+
+        auto worker = [&]()
+        {
+            try
+            {
+                for (int i = next_task++; i < task_count && !failed; i = next_task++) { task(i); }
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) { error = std::current_exception(); }
+                failed = true;
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (unsigned i = 1; i < thread_count; ++i) { threads.emplace_back(worker); }
+
+        worker();
+        for (std::thread& thread : threads) { thread.join(); }
+
+        if (error) { std::rethrow_exception(error); }
+    }
+
+    /*  Вспомогательный метод, который ищет такие целые scale (16 бит) и offset, что table[v] = clamp((v * scale + offset) >> shift, 0, 255)
+        для всех v (см. transformSpan). Наклон оценивается по крайним "необрезанным" значениям таблицы, а для каждого
+        близкого scale допустимые offset - это пересечение отрезков, которые задает каждое такое значение.  */
+    static bool findLinearTable(const std::array<uint8_t, 256>& table, int shift, int16_t& scale, int32_t& offset)
+    {
+        auto matches = [&](int32_t a, int32_t b)
+        {
+            for (int value = 0; value < 256; ++value) {
+                if (std::clamp((value * a + b) >> shift, 0, 255) != table[value]) { return false; }
+            }
+
+            return true;
+        };
+
+        // Постоянная таблица.
+        if (matches(0, table[0] << shift)) { scale = 0; offset = table[0] << shift; return true; }
+
+        int first = -1, last = -1;
+        for (int value = 0; value < 256; ++value)
+        {
+            if (table[value] > 0 && table[value] < 255) { if (first < 0) { first = value; } last = value; }
+        }
+
+        if (first < 0 || first == last) { return false; }
+
+        double slope = static_cast<double>(table[last] - table[first]) / (last - first);
+
+        int32_t estimate = static_cast<int32_t>(std::lround(std::ldexp(slope, shift)));
+
+        for (int32_t a = estimate - 2; a <= estimate + 2; ++a)
+        {
+            if (a < -32768 || a > 32767) { continue; }
+
+            int64_t low = INT32_MIN, high = INT32_MAX;
+            for (int value = first; value <= last; ++value)
+            {
+                low  = std::max<int64_t>(low, (static_cast<int64_t>(table[value]) << shift) - static_cast<int64_t>(value) * a);
+                high = std::min<int64_t>(high, (static_cast<int64_t>(table[value] + 1) << shift) - 1 - static_cast<int64_t>(value) * a);
+            }
+
+            if (low <= high && matches(a, static_cast<int32_t>(low)))
+            {
+                scale  = static_cast<int16_t>(a);
+                offset = static_cast<int32_t>(low);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /*  Вспомогательный метод, на котором построены обе версии histogram: row(y) - указатель на строку y
+        области размера width x height.  */
+    template <typename Row>
+    static Histogram histogramOfRows(const Row& row, int width, int height, unsigned thread_count)
+    {
+        /* 1.   Количество полос: по 4 на поток (для балансировки нагрузки), но не меньше, чем нужно, чтобы
+                в полосе было меньше 2^31 пикселей - тогда счетчикам полосы хватает 32 бит.  */
+        if (thread_count == 0) { thread_count = std::max(1u, std::thread::hardware_concurrency()); }
+
+        int64_t total = static_cast<int64_t>(width) * height;
+        int band_count = static_cast<int>(std::max<int64_t>(4 * thread_count, total / (int64_t(1) << 31) + 1));
+        band_count = std::max(1, std::min(band_count, height));
+
+        std::vector<Histogram> partial(band_count);
+
+        runParallel(band_count, thread_count, [&](int band)
+        {
+            // 2. Счетчики полосы: counts[копия][канал][значение], каналы - синий, зеленый, красный и яркость.
+            uint32_t counts[4][4][256] = {};
+
+            auto count = [&](int copy, uint32_t color)
+            {
+                ++counts[copy][0][(color >> 16) & 0xFF];
+                ++counts[copy][1][(color >> 8) & 0xFF];
+                ++counts[copy][2][color & 0xFF];
+                ++counts[copy][3][luminance(color)];
+            };
+
+            int64_t band_begin = static_cast<int64_t>(height) * band / band_count;
+            int64_t band_end   = static_cast<int64_t>(height) * (band + 1) / band_count;
+
+            for (int y = static_cast<int>(band_begin); y < band_end; ++y)
+            {
+                const uint32_t* current = row(y);
+                int x = 0;
+
+                for (; x + 4 <= width; x += 4)
+                {
+                    count(0, current[x]);
+                    count(1, current[x + 1]);
+                    count(2, current[x + 2]);
+                    count(3, current[x + 3]);
+                }
+
+                for (; x < width; ++x) { count(0, current[x]); }
+            }
+
+            // 3. Складываю копии счетчиков.
+            Histogram& result = partial[band];
+
+            for (int value = 0; value < 256; ++value)
+            {
+                for (int copy = 0; copy < 4; ++copy)
+                {
+                    result.blue[value]      += counts[copy][0][value];
+                    result.green[value]     += counts[copy][1][value];
+                    result.red[value]       += counts[copy][2][value];
+                    result.luminance[value] += counts[copy][3][value];
+                }
+            }
+        });
+
+        // 4. Складываю гистограммы полос.
+        Histogram result;
+
+        for (const Histogram& current : partial)
+        {
+            for (int value = 0; value < 256; ++value)
+            {
+                result.blue[value]      += current.blue[value];
+                result.green[value]     += current.green[value];
+                result.red[value]       += current.red[value];
+                result.luminance[value] += current.luminance[value];
+            }
+        }
+
+        return result;
+    }
+
+    /*  Вспомогательный метод, который строит таблицу сумм (см. SummedAreaTable) по одноканальному изображению image:
+        (width + 1) x (height + 1) элементов, элемент (x, y) - сумма яркостей прямоугольника [0, x) x [0, y)
+        по модулю 2^32 (разность четырех элементов точна, пока сумма по прямоугольнику меньше 2^32).  */
+    static std::vector<uint32_t> lumaSummedAreaTable(const GrayImage& image, unsigned thread_count)
+    {
+        const size_t stride = static_cast<size_t>(image.width()) + 1;
+        std::vector<uint32_t> table(stride * (image.height() + 1), 0);
+
+        // 1. Префиксные суммы каждой строки (строка y изображения -> строка y + 1 таблицы).
+        runParallel(image.height(), thread_count, [&](int y)
+        {
+            const uint8_t* source = image.row(y);
+            uint32_t* row = table.data() + (y + 1) * stride;
+            uint32_t sum = 0;
+
+            for (int x = 0; x < image.width(); ++x) { row[x + 1] = sum += source[x]; }
+        });
+
+        // 2. Накопление по вертикали (полосами по 256 столбцов).
+        const int strip = 256;
+        int strip_count = static_cast<int>((stride + strip - 1) / strip);
+
+        runParallel(strip_count, thread_count, [&](int index)
+        {
+            size_t begin = index * strip;
+            size_t end   = std::min(begin + strip, stride);
+
+            for (int y = 2; y <= image.height(); ++y)
+            {
+                uint32_t* row = table.data() + y * stride;
+                const uint32_t* previous = row - stride;
+
+                for (size_t i = begin; i < end; ++i) { row[i] += previous[i]; }
+            }
+        });
+
+        return table;
+    }
+
+    // Вспомогательный метод, который переводит count пикселей строки row в пространство space (в плоскости first, second, third).
+    static void colorRowToSpace(ColorSpace space, const uint32_t* row, int count, float* first, float* second, float* third)
+    {
+        unpackColorRow(row, count, space == ColorSpace::Lab, first, second, third);
+
+        switch (space)
+        {
+            case ColorSpace::HSV:   forEachLane(count, [&](auto lanes, int i) { rgbToHsv<decltype(lanes)>(first, second, third, i); });   break;
+            case ColorSpace::HSL:   forEachLane(count, [&](auto lanes, int i) { rgbToHsl<decltype(lanes)>(first, second, third, i); });   break;
+            case ColorSpace::YCbCr: forEachLane(count, [&](auto lanes, int i) { rgbToYCbCr<decltype(lanes)>(first, second, third, i); }); break;
+            case ColorSpace::Lab:   forEachLane(count, [&](auto lanes, int i) { rgbToLab<decltype(lanes)>(first, second, third, i); });   break;
+        }
+    }
+
+    /*  Вспомогательный метод, обратный colorRowToSpace: переводит count элементов плоскостей first, second, third
+        из пространства space в пиксели строки row (плоскости при этом портятся - используются как рабочая память).  */
+    static void colorRowFromSpace(ColorSpace space, float* first, float* second, float* third, int count, uint32_t* row)
+    {
+        switch (space)
+        {
+            case ColorSpace::HSV:   forEachLane(count, [&](auto lanes, int i) { hsvToRgb<decltype(lanes)>(first, second, third, i); });   break;
+            case ColorSpace::HSL:   forEachLane(count, [&](auto lanes, int i) { hslToRgb<decltype(lanes)>(first, second, third, i); });   break;
+            case ColorSpace::YCbCr: forEachLane(count, [&](auto lanes, int i) { yCbCrToRgb<decltype(lanes)>(first, second, third, i); }); break;
+            case ColorSpace::Lab:   forEachLane(count, [&](auto lanes, int i) { labToRgb<decltype(lanes)>(first, second, third, i); });   break;
+        }
+
+        packColorRow(first, second, third, count, space == ColorSpace::Lab, row);
+    }
+
+    // Количество дробных бит в весах ядер свертки (вес 1.0 соответствует числу 4096).
+    static const int fixed_point_bits = 12;
+
+    /*  Наибольшая sigma размытий, стоимость которых не зависит от sigma (approximateGaussianBlur). Окно такого размытия
+        уже намного больше любого изображения, а ширины окон и их квадраты при этом еще далеки от переполнения int.  */
+    static constexpr double blur_sigma_limit = 8192.0;
+
+    /*  Наибольшая sigma точных гауссовых размытий (gaussianBlur, recursiveGaussianBlur и размытие в canny). У ядер с большей sigma (см. gaussianWeights)
+        веса хвостов меньше половины младшего разряда и округляются до нуля, а рекурсивный фильтр в числах float
+        накапливает ошибку больше одного уровня яркости.  */
+    static constexpr double gaussian_sigma_limit = 64.0;
+
+    // Вспомогательный метод, который переводит веса ядра в формат с фиксированной точкой.
+    static std::vector<int16_t> toFixedPoint(const std::vector<float>& kernel)
+    {
+        std::vector<int16_t> result(kernel.size());
+
+        for (size_t i = 0; i < kernel.size(); ++i)
+        {
+            if (std::fabs(kernel[i]) >= 8.0f) {
+                throw std::runtime_error("Error! The weights of the convolution kernel must be in the range (-8, 8).");
+            }
+
+            result[i] = static_cast<int16_t>(std::lround(kernel[i] * (1 << fixed_point_bits)));
+        }
+
+        return result;
+    }
+
+    /*  Вспомогательный метод, который строит гауссово ядро радиуса ceil(3 * sigma) в формате с фиксированной точкой.
+        После округления сумма весов может отличаться от 1.0, поэтому остаток добавляется к центральному весу
+        (как в makeResampleTable) - иначе размытие меняло бы яркость однотонных областей.  */
+    static std::vector<int16_t> gaussianWeights(double sigma)
+    {
+        const int radius = static_cast<int>(std::ceil(3.0 * sigma));
+        std::vector<float> kernel(2 * radius + 1);
+
+        double sum = 0.0;
+        for (int i = -radius; i <= radius; ++i) { sum += std::exp(-0.5 * i * i / (sigma * sigma)); }
+        for (int i = -radius; i <= radius; ++i) { kernel[i + radius] = static_cast<float>(std::exp(-0.5 * i * i / (sigma * sigma)) / sum); }
+
+        std::vector<int16_t> weights = toFixedPoint(kernel);
+
+        int total = 0;
+        for (int16_t weight : weights) { total += weight; }
+        weights[radius] = static_cast<int16_t>(weights[radius] + (1 << fixed_point_bits) - total);
+
+        return weights;
+    }
+
+    // Рабочие буферы одной полосы строк (у каждого потока - свои, размер задается при первом использовании).
+    struct ConvolutionScratch
+    {
+        std::vector<int16_t> expanded;
+        std::vector<int32_t> sums;
+        std::vector<const int16_t*> sources;
+    };
+
+    /*  Вспомогательный метод, на котором построены все свертки. Для вычисления выходной строки y нужны
+        подготовленные (prepare) строки с y - radius_top по y + radius_bottom (за границами изображения
+        берутся крайние строки), из которых combine собирает результат. Подготовленные строки хранятся
+        в кольцевом буфере, поэтому каждая строка готовится один раз, а результат можно записывать прямо
+        на место исходной строки (она к этому моменту уже лежит в буфере).
+        Для работы в несколько потоков изображение делится на полосы. Перед началом обработки каждая полоса
+        заранее готовит строки соседей сверху и копирует строки соседей снизу, ведь соседние полосы
+        перезапишут их раньше, чем до них дойдет очередь.  */
+    template <typename Prepare, typename Combine>
+    void convolveRowBands(int radius_top, int radius_bottom, int prepared_length, unsigned thread_count,
+                          Prepare prepare, Combine combine)
+    {
+        const int width  = info_block.width;
+        const int height = info_block.height;
+        const int window = radius_top + radius_bottom + 1;
+
+        if (width == 0 || height == 0) { return; }
+
+        if (thread_count == 0) { thread_count = std::max(1u, std::thread::hardware_concurrency()); }
+        int band_count = std::min<int>(thread_count, height);
+        int band_height = (height + band_count - 1) / band_count;
+        band_count = (height + band_height - 1) / band_height;
+
+        // Состояние одной полосы: рабочие буферы, кольцевой буфер и копии нижних соседних строк.
+        struct Band
+        {
+            ConvolutionScratch scratch;
+            std::vector<std::vector<int16_t>> ring;
+            std::vector<std::vector<uint32_t>> bottom_halo;
+        };
+
+        std::vector<Band> bands(band_count);
+
+        auto clamp_row = [height](int row) { return std::clamp(row, 0, height - 1); };
+
+        /* 1.   Подготовка полос: выделяю память, готовлю строки выше полосы (их индексы в кольцевом буфере
+                совпадают с теми, что будут использоваться дальше) и копирую строки ниже полосы.  */
+        runParallel(band_count, thread_count, [&](int index)
+        {
+            Band& band = bands[index];
+            int band_begin = index * band_height;
+            int band_end   = std::min(band_begin + band_height, height);
+
+            band.scratch.sums.resize(4 * width);
+            band.ring.assign(window, std::vector<int16_t>(prepared_length));
+
+            for (int row = band_begin - radius_top; row < band_begin; ++row) {
+                prepare(pixels[clamp_row(row)].data(), band.ring[(row + window * 2) % window].data(), band.scratch);
+            }
+
+            for (int row = band_end; row < band_end + radius_bottom; ++row) {
+                band.bottom_halo.push_back(pixels[clamp_row(row)]);
+            }
+        });
+
+        // 2. Основная обработка: каждая полоса идет сверху вниз, подготавливая по одной новой строке на шаг.
+        runParallel(band_count, thread_count, [&](int index)
+        {
+            Band& band = bands[index];
+            int band_begin = index * band_height;
+            int band_end   = std::min(band_begin + band_height, height);
+
+            std::vector<const int16_t*> rows(window);
+
+            // Готовит строку row в кольцевой буфер (строки ниже полосы берутся из сохраненных копий).
+            auto load = [&](int row)
+            {
+                const uint32_t* source = (row < band_end) ? pixels[clamp_row(row)].data()
+                                                          : band.bottom_halo[row - band_end].data();
+                prepare(source, band.ring[(row + window * 2) % window].data(), band.scratch);
+            };
+
+            for (int row = band_begin; row < band_begin + radius_bottom; ++row) { load(row); }
+
+            for (int y = band_begin; y < band_end; ++y)
+            {
+                load(y + radius_bottom);
+
+                for (int i = 0; i < window; ++i) { rows[i] = band.ring[(y - radius_top + i + window * 2) % window].data(); }
+
+                combine(rows.data(), pixels[y].data(), band.scratch);
+            }
+        });
+    }
+
+    /*  Один проход box blur: горизонтальное окно радиуса radius_x и вертикальное окно радиуса radius_y.
+        Делитель (ширина окна) заменяется умножением на заранее вычисленную обратную величину.  */
+    void boxBlurPass(int radius_x, int radius_y, unsigned thread_count)
+    {
+        const int width  = info_block.width;
+        const int height = info_block.height;
+
+        // Вспомогательная функция: (sum / window) с округлением через умножение на 2^32 / window.
+        auto make_divider = [](int window)
+        {
+            uint64_t reciprocal = ((uint64_t(1) << 32) + window - 1) / window;
+            uint64_t half = uint64_t(1) << 31;
+            return [reciprocal, half](uint32_t sum) { return static_cast<uint32_t>((sum * reciprocal + half) >> 32); };
+        };
+
+        /* 1.   Горизонтальный проход: каждая строка копируется в буфер с дополнением крайними пикселями,
+                после чего окно скользит по буферу, а результат пишется прямо в строку.  */
+        if (radius_x > 0)
+        {
+            auto divide = make_divider(2 * radius_x + 1);
+
+            runParallel(height, thread_count, [&](int y)
+            {
+                thread_local std::vector<uint32_t> padded;
+                padded.resize(width + 2 * radius_x + 1);
+
+                std::fill_n(padded.begin(), radius_x + 1, pixels[y][0]);
+                std::copy(pixels[y].begin(), pixels[y].end(), padded.begin() + radius_x + 1);
+                std::fill_n(padded.begin() + radius_x + 1 + width, radius_x, pixels[y][width - 1]);
+
+                // Начальное окно для x = -1 (чтобы в цикле сначала сдвигать, а потом записывать).
+                uint32_t red = 0, green = 0, blue = 0;
+                for (int i = 0; i < 2 * radius_x + 1; ++i)
+                {
+                    red   += padded[i] & 0xFF;
+                    green += (padded[i] >> 8) & 0xFF;
+                    blue  += (padded[i] >> 16) & 0xFF;
+                }
+
+                for (int x = 0; x < width; ++x)
+                {
+                    uint32_t incoming = padded[x + 2 * radius_x + 1];
+                    uint32_t outgoing = padded[x];
+
+                    red   += (incoming & 0xFF)         - (outgoing & 0xFF);
+                    green += ((incoming >> 8) & 0xFF)  - ((outgoing >> 8) & 0xFF);
+                    blue  += ((incoming >> 16) & 0xFF) - ((outgoing >> 16) & 0xFF);
+
+                    pixels[y][x] = (divide(blue) << 16) | (divide(green) << 8) | divide(red);
+                }
+            });
+        }
+
+        /* 2.   Вертикальный проход: изображение делится на полосы по 64 столбца, и в каждой полосе
+                окно скользит сверху вниз сразу для всех столбцов (обращения к памяти идут подряд).
+                Строка y перезаписывается результатом, поэтому ее исходные значения сохраняются
+                в кольцевом буфере из radius_y + 1 строк - они понадобятся, когда строка будет уходить из окна.  */
+        if (radius_y > 0)
+        {
+            auto divide = make_divider(2 * radius_y + 1);
+            const int strip = 64;
+            int strip_count = (width + strip - 1) / strip;
+
+            runParallel(strip_count, thread_count, [&](int index)
+            {
+                int x_begin = index * strip;
+                int count = std::min(strip, width - x_begin);
+
+                std::vector<uint32_t> red(count), green(count), blue(count);
+                std::vector<uint32_t> saved((radius_y + 1) * count);
+
+                auto add = [&](const uint32_t* row, int sign)
+                {
+                    for (int i = 0; i < count; ++i)
+                    {
+                        red[i]   += sign * static_cast<int>(row[i] & 0xFF);
+                        green[i] += sign * static_cast<int>((row[i] >> 8) & 0xFF);
+                        blue[i]  += sign * static_cast<int>((row[i] >> 16) & 0xFF);
+                    }
+                };
+
+                // Начальное окно для y = 0: строки с -radius_y по radius_y (с продолжением краев).
+                for (int j = -radius_y; j <= radius_y; ++j) { add(pixels[std::clamp(j, 0, height - 1)].data() + x_begin, 1); }
+
+                for (int y = 0; y < height; ++y)
+                {
+                    uint32_t* row = pixels[y].data() + x_begin;
+                    std::copy_n(row, count, saved.data() + (y % (radius_y + 1)) * count);
+
+                    for (int i = 0; i < count; ++i) { row[i] = (divide(blue[i]) << 16) | (divide(green[i]) << 8) | divide(red[i]); }
+
+                    if (y + 1 == height) { break; }
+
+                    // Сдвигаю окно: входит строка y + radius_y + 1 (она еще не перезаписана), уходит строка y - radius_y.
+                    add(pixels[std::min(y + radius_y + 1, height - 1)].data() + x_begin, 1);
+
+                    int outgoing = std::max(y - radius_y, 0);
+                    add(saved.data() + (outgoing % (radius_y + 1)) * count, -1);
+                }
+            });
+        }
+    }
+
+    /*  Вспомогательный метод, который записывает в строки [y_begin, y_end) результата result медианы окон
+        (2 * radius + 1)^2 сетью сравнений (radius = 1 или 2). Строки полосы вместе с radius соседними строками
+        копируются с продолжением крайних пикселей на radius пикселей влево и вправо, поэтому окно любого
+        пикселя читается без проверок границ.  */
+    void medianBandNetwork(int radius, int y_begin, int y_end, std::vector<std::vector<uint32_t>>& result) const
+    {
+        static const std::vector<std::pair<int, int>> networks[2] = { medianNetwork(9), medianNetwork(25) };
+
+        const int width = info_block.width, height = info_block.height;
+        const int size = 2 * radius + 1, count = size * size;
+        const std::vector<std::pair<int, int>>& network = networks[radius - 1];
+
+        // 1. Строки y_begin - radius .. y_end + radius - 1 с продолженными краями.
+        std::vector<std::vector<uint32_t>> padded(y_end - y_begin + 2 * radius, std::vector<uint32_t>(width + 2 * radius));
+
+        for (int i = 0; i < static_cast<int>(padded.size()); ++i)
+        {
+            const std::vector<uint32_t>& source = pixels[std::clamp(y_begin - radius + i, 0, height - 1)];
+            for (int x = -radius; x < width + radius; ++x) { padded[i][x + radius] = source[std::clamp(x, 0, width - 1)]; }
+        }
+
+        for (int y = y_begin; y < y_end; ++y)
+        {
+            const std::vector<uint32_t>* rows = padded.data() + (y - y_begin);
+            uint32_t* target = result[y].data();
+            int x = 0;
+
+#if defined(__SSE2__)
+            // 2. По 4 пикселя: побайтовые минимум и максимум сортируют все каналы сразу.
+            __m128i values[25];
+
+            for (; x + 4 <= width; x += 4)
+            {
+                for (int dy = 0, i = 0; dy < size; ++dy) {
+                    for (int dx = 0; dx < size; ++dx, ++i) { values[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[dy].data() + x + dx)); }
+                }
+
+                for (const std::pair<int, int>& pair : network)
+                {
+                    __m128i low = _mm_min_epu8(values[pair.first], values[pair.second]);
+                    values[pair.second] = _mm_max_epu8(values[pair.first], values[pair.second]);
+                    values[pair.first]  = low;
+                }
+
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(target + x), values[count / 2]);
+            }
+#endif
+
+            // 3. Оставшиеся пиксели - по каналам.
+            for (; x < width; ++x)
+            {
+                for (int shift = 0; shift < 24; shift += 8)
+                {
+                    uint8_t channel[25];
+                    for (int dy = 0, i = 0; dy < size; ++dy) {
+                        for (int dx = 0; dx < size; ++dx, ++i) { channel[i] = (rows[dy][x + dx] >> shift) & 0xFF; }
+                    }
+
+                    for (const std::pair<int, int>& pair : network)
+                    {
+                        uint8_t low = std::min(channel[pair.first], channel[pair.second]);
+                        channel[pair.second] = std::max(channel[pair.first], channel[pair.second]);
+                        channel[pair.first]  = low;
+                    }
+
+                    target[x] |= static_cast<uint32_t>(channel[count / 2]) << shift;
+                }
+            }
+        }
+    }
+
+    /*  Вспомогательный метод, который записывает в строки [y_begin, y_end) результата result медианы окон
+        (2 * radius + 1)^2 методом Перро-Эбера (S. Perreault, P. Hebert, "Median Filtering in Constant Time").
+        Для каждого столбца хранится гистограмма его 2 * radius + 1 пикселей вокруг текущей строки: при переходе
+        к следующей строке в ней меняются два счетчика. Гистограмма окна при сдвиге вправо получается прибавлением
+        гистограммы входящего столбца и вычитанием уходящего - стоимость не зависит от радиуса.
+        Гистограммы двухуровневые: 16 грубых ячеек (старшие 4 бита значения) и 256 точных. Медиана сначала
+        ищется среди грубых ячеек, а точные счетчики окна обновляются только для найденной грубой ячейки
+        и только когда она понадобилась (с того столбца, на котором ее обновляли в последний раз).
+        Каналы обрабатываются по очереди, а полоса строк - вертикальными полосами по median_strip столбцов:
+        так гистограммы столбцов (512 байт точных счетчиков на столбец) помещаются в кэш процессора.  */
+    void medianBandHistogram(int radius, int y_begin, int y_end, std::vector<std::vector<uint32_t>>& result) const
+    {
+        const int width = info_block.width, height = info_block.height;
+        const int size = 2 * radius + 1, rank = size * size / 2;
+
+        // Прибавляет (sign = 1) или вычитает (sign = -1) 16 счетчиков source из target.
+        auto add_counts = [](uint16_t* target, const uint16_t* source, int sign)
+        {
+#if defined(__SSE2__)
+            for (int i = 0; i < 16; i += 8)
+            {
+                __m128i counts = _mm_loadu_si128(reinterpret_cast<const __m128i*>(target + i));
+                __m128i change = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+                counts = sign > 0 ? _mm_add_epi16(counts, change) : _mm_sub_epi16(counts, change);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(target + i), counts);
+            }
+#else
+            for (int i = 0; i < 16; ++i) { target[i] += sign * source[i]; }
+#endif
+        };
+
+        std::vector<uint16_t> column_coarse, column_fine;
+
+        for (int channel = 0; channel < 3; ++channel) {
+            for (int x_begin = 0; x_begin < width; x_begin += median_strip)
+            {
+                /* 1.   Гистограммы столбцов полосы [x_begin, x_end) вместе с radius столбцами по бокам:
+                        грубые - по 16 счетчиков, точные - по 256. Столбцы за границами изображения
+                        совпадают с крайними, поэтому номер столбца сначала ограничивается.  */
+                const int x_end = std::min(x_begin + median_strip, width);
+                const int first_column = std::max(x_begin - radius, 0);
+                const int columns = std::min(x_end + radius, width) - first_column;
+
+                auto column = [&](int x) { return std::clamp(x, 0, width - 1) - first_column; };
+
+                column_coarse.assign(static_cast<size_t>(columns) * 16, 0);
+                column_fine.assign(static_cast<size_t>(columns) * 256, 0);
+
+                auto update_row = [&](int y, int delta)
+                {
+                    const uint32_t* row = pixels[std::clamp(y, 0, height - 1)].data() + first_column;
+
+                    for (int x = 0; x < columns; ++x)
+                    {
+                        uint32_t value = (row[x] >> (8 * channel)) & 0xFF;
+                        column_coarse[x * 16 + (value >> 4)] += delta;
+                        column_fine[x * 256 + value] += delta;
+                    }
+                };
+
+                for (int dy = -radius; dy <= radius; ++dy) { update_row(y_begin + dy, 1); }
+
+                for (int y = y_begin; y < y_end; ++y)
+                {
+                    // 2. Сдвигаю гистограммы столбцов на строку вниз.
+                    if (y > y_begin)
+                    {
+                        update_row(y - radius - 1, -1);
+                        update_row(y + radius, 1);
+                    }
+
+                    // 3. Прохожу строку полосы слева направо.
+                    uint16_t window_coarse[16] = {};
+                    uint16_t window_fine[256];
+                    int synced[16];
+                    std::fill(synced, synced + 16, std::numeric_limits<int>::min() / 4);
+
+                    for (int dx = -radius; dx <= radius; ++dx) { add_counts(window_coarse, column_coarse.data() + column(x_begin + dx) * 16, 1); }
+
+                    for (int x = x_begin; x < x_end; ++x)
+                    {
+                        if (x > x_begin)
+                        {
+                            add_counts(window_coarse, column_coarse.data() + column(x + radius) * 16, 1);
+                            add_counts(window_coarse, column_coarse.data() + column(x - radius - 1) * 16, -1);
+                        }
+
+                        // 3.1 Грубая ячейка, в которую попадает медиана (rank значений окна меньше нее).
+                        int below = 0, bucket = 0;
+                        while (below + window_coarse[bucket] <= rank) { below += window_coarse[bucket++]; }
+
+                        /* 3.2  Довожу точные счетчики этой ячейки до столбца x: по одному столбцу,
+                                если ячейку обновляли недавно, иначе считаю их заново по всем столбцам окна.  */
+                        uint16_t* segment = window_fine + bucket * 16;
+                        const uint16_t* fine = column_fine.data() + bucket * 16;
+
+                        if (2 * (x - synced[bucket]) > size)
+                        {
+                            std::fill(segment, segment + 16, 0);
+                            for (int dx = -radius; dx <= radius; ++dx) { add_counts(segment, fine + column(x + dx) * 256, 1); }
+                        }
+                        else
+                        {
+                            for (int j = synced[bucket] + 1; j <= x; ++j)
+                            {
+                                add_counts(segment, fine + column(j + radius) * 256, 1);
+                                add_counts(segment, fine + column(j - radius - 1) * 256, -1);
+                            }
+                        }
+
+                        synced[bucket] = x;
+
+                        // 3.3 Медиана внутри ячейки.
+                        int value = 0;
+                        while (below + segment[value] <= rank) { below += segment[value++]; }
+
+                        result[y][x] |= static_cast<uint32_t>(bucket * 16 + value) << (8 * channel);
+                    }
+                }
+            }
+        }
+    }
+
+    // Ширина вертикальной полосы (в столбцах), которой medianBandHistogram обходит изображение.
+    static const int median_strip = 256;
+
+    /*  Вспомогательный метод (SIMD-ядро морфологии): result[i] = max(a[i], b[i]) при dilate = true, иначе min.
+        result может совпадать с a или b.  */
+    static void combineBytes(const uint8_t* a, const uint8_t* b, int count, bool dilate, uint8_t* result)
+    {
+        int i = 0;
+
+#if defined(__SSE2__)
+        for (; i + 16 <= count; i += 16)
+        {
+            __m128i first  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(result + i), dilate ? _mm_max_epu8(first, second) : _mm_min_epu8(first, second));
+        }
+#endif
+
+        for (; i < count; ++i) { result[i] = dilate ? std::max(a[i], b[i]) : std::min(a[i], b[i]); }
+    }
+
+    /*  Вспомогательный метод, который заменяет каждый из width байтов row минимумом (или максимумом при dilate = true)
+        по окну [x - radius, x + radius] алгоритмом ван Херка - Гил-Вермана. Строка, дополненная с обеих сторон
+        radius значениями identity, делится на блоки длины k = 2 * radius + 1; forward[i] - минимум от начала блока
+        до i, backward[i] - от i до конца блока. Окно длины k пересекает не больше двух блоков, поэтому минимум
+        по окну, начинающемуся в i, равен min(backward[i], forward[i + k - 1]). buffer - рабочая память.  */
+    static void vanHerkRow(uint8_t* row, int width, int radius, uint8_t identity, bool dilate, std::vector<uint8_t>& buffer)
+    {
+        const int size = 2 * radius + 1;
+        const int length = (width + 2 * radius + size - 1) / size * size;
+
+        buffer.assign(3 * static_cast<size_t>(length), identity);
+        uint8_t* padded   = buffer.data();
+        uint8_t* forward  = padded + length;
+        uint8_t* backward = forward + length;
+
+        std::copy(row, row + width, padded + radius);
+
+        auto combine = [dilate](uint8_t a, uint8_t b) { return dilate ? std::max(a, b) : std::min(a, b); };
+
+        for (int block = 0; block < length; block += size)
+        {
+            forward[block] = padded[block];
+            for (int i = block + 1; i < block + size; ++i) { forward[i] = combine(forward[i - 1], padded[i]); }
+
+            backward[block + size - 1] = padded[block + size - 1];
+            for (int i = block + size - 2; i >= block; --i) { backward[i] = combine(backward[i + 1], padded[i]); }
+        }
+
+        for (int x = 0; x < width; ++x) { row[x] = combine(backward[x], forward[x + size - 1]); }
+    }
+
+    /*  Вспомогательный метод, который заменяет каждый элемент изображения data (height строк по columns элементов
+        с шагом stride) минимумом (или максимумом) по столбцу в окне [y - radius, y + radius] алгоритмом ван Херка -
+        Гил-Вермана (см. vanHerkRow): блоки здесь состоят из строк, а combine(a, b, count, result) объединяет
+        строки целиком. Изображение делится на вертикальные полосы, которые обрабатываются в thread_count потоках.  */
+    template <typename T, typename Combine>
+    static void vanHerkColumns(T* data, size_t stride, int columns, int height, int radius, T identity, const Combine& combine, unsigned thread_count)
+    {
+        const int size   = 2 * radius + 1;
+        const int length = (height + 2 * radius + size - 1) / size * size;
+        const int strip  = std::max(1, static_cast<int>(1024 / sizeof(T)));
+
+        runParallel((columns + strip - 1) / strip, thread_count, [&](int index)
+        {
+            const int x_begin = index * strip;
+            const int count   = std::min(strip, columns - x_begin);
+
+            std::vector<T> blank(count, identity);
+            std::vector<T> forward(static_cast<size_t>(length) * count), backward(static_cast<size_t>(length) * count);
+
+            // Строка i дополненного изображения - это строка i - radius исходного (вне изображения - нейтральные значения).
+            auto source = [&](int i) -> const T* {
+                int y = i - radius;
+                return y >= 0 && y < height ? data + y * stride + x_begin : blank.data();
+            };
+            auto forward_row  = [&](int i) { return forward.data() + static_cast<size_t>(i) * count; };
+            auto backward_row = [&](int i) { return backward.data() + static_cast<size_t>(i) * count; };
+
+            for (int block = 0; block < length; block += size)
+            {
+                std::copy(source(block), source(block) + count, forward_row(block));
+                for (int i = block + 1; i < block + size; ++i) { combine(forward_row(i - 1), source(i), count, forward_row(i)); }
+
+                std::copy(source(block + size - 1), source(block + size - 1) + count, backward_row(block + size - 1));
+                for (int i = block + size - 2; i >= block; --i) { combine(backward_row(i + 1), source(i), count, backward_row(i)); }
+            }
+
+            for (int y = 0; y < height; ++y) { combine(backward_row(y), forward_row(y + size - 1), count, data + y * stride + x_begin); }
+        });
+    }
+
+    /*  Вспомогательный метод, который заменяет каждый из width битов строки row (64 бита в слове, левый пиксель -
+        старший бит) "и" (или "или" при dilate = true) битов в окне [x - radius, x + radius]. Строка сдвигается
+        на radius битов вправо (слева вдвигаются нейтральные биты), после чего window(x) - объединение битов
+        [x, x + length) - наращивается удвоением: window_2s(x) = window_s(x) и window_s(x + s), а к результату
+        добавляются окна, соответствующие единичным битам длины 2 * radius + 1. buffer - рабочая память.  */
+    static void shiftWindowRow(uint64_t* row, int width, int radius, bool dilate, std::vector<uint64_t>& buffer)
+    {
+        const int words = (width + 63) / 64;
+        const int padded_words = (width + 2 * radius + 63) / 64;
+        const uint64_t identity = dilate ? 0 : ~uint64_t(0);
+
+        buffer.assign(3 * static_cast<size_t>(padded_words), identity);
+        uint64_t* window = buffer.data();
+        uint64_t* result = window + padded_words;
+        uint64_t* shifted = result + padded_words;
+
+        auto combine = [dilate](uint64_t a, uint64_t b) { return dilate ? (a | b) : (a & b); };
+
+        // Сдвиг битовой строки source на shift битов к началу строки (target(x) = source(x + shift)), с конца вдвигается identity.
+        auto shift_left = [&](const uint64_t* source, int shift, uint64_t* target)
+        {
+            int skip = shift / 64, bits = shift % 64;
+            for (int i = 0; i < padded_words; ++i)
+            {
+                uint64_t high = i + skip < padded_words ? source[i + skip] : identity;
+                uint64_t low  = i + skip + 1 < padded_words ? source[i + skip + 1] : identity;
+                target[i] = bits == 0 ? high : (high << bits) | (low >> (64 - bits));
+            }
+        };
+
+        // 1. window = строка, сдвинутая на radius битов вправо; биты за правым краем изображения - нейтральные.
+        for (int i = 0; i < words; ++i)
+        {
+            uint64_t value = row[i];
+            if (i == words - 1 && width % 64 != 0) {
+                uint64_t mask = ~uint64_t(0) << (64 - width % 64);
+                value = (value & mask) | (identity & ~mask);
+            }
+            shifted[i] = value;
+        }
+
+        int skip = radius / 64, bits = radius % 64;
+        for (int i = 0; i < padded_words; ++i)
+        {
+            uint64_t high = i - skip >= 0 && i - skip < words ? shifted[i - skip] : identity;
+            uint64_t low  = i - skip - 1 >= 0 && i - skip - 1 < words ? shifted[i - skip - 1] : identity;
+            window[i] = bits == 0 ? high : (high >> bits) | (low << (64 - bits));
+        }
+
+        // 2. result - объединение окон, покрывающих [x, x + 2 * radius + 1): складываю окна длины степени двойки.
+        const int size = 2 * radius + 1;
+        int covered = 0;
+        std::fill(result, result + padded_words, identity);
+
+        for (int length = 1; ; length *= 2)
+        {
+            if (size & length)
+            {
+                shift_left(window, covered, shifted);
+                for (int i = 0; i < padded_words; ++i) { result[i] = combine(result[i], shifted[i]); }
+                covered += length;
+            }
+
+            if (2 * length > size) { break; }
+
+            shift_left(window, length, shifted);
+            for (int i = 0; i < padded_words; ++i) { window[i] = combine(window[i], shifted[i]); }
+        }
+
+        std::copy(result, result + words, row);
+    }
+
+    // Высота полосы строк, которыми gradientMagnitude и canny делят изображение между потоками.
+    static const int edge_band = 64;
+
+    /*  Вспомогательный метод, который считает градиент (см. gradientRow) строк [y_begin, y_end) изображения
+        width x height и передает каждую строку в consume(y, gx, gy, magnitude). Строки яркости получаются
+        из load_row(y, target) (width байтов в target) и хранятся в кольце из трех строк: каждая строка
+        загружается один раз, дополняется продолженными крайними пикселями, а строки за верхней и нижней
+        границами изображения заменяются крайними строками.  */
+    template <typename LoadRow, typename Consume>
+    static void gradientRows(int y_begin, int y_end, int width, int height, GradientOperator gradient_operator,
+                             const LoadRow& load_row, const Consume& consume)
+    {
+        const int side   = gradient_operator == GradientOperator::Sobel ? 1 : 3;
+        const int center = gradient_operator == GradientOperator::Sobel ? 2 : 10;
+        const size_t padded = static_cast<size_t>(width) + 2;
+
+        std::vector<uint8_t> luma(3 * padded);
+        std::vector<int16_t> gradient(3 * static_cast<size_t>(width));
+        int16_t *gx = gradient.data(), *gy = gx + width, *magnitude = gy + width;
+
+        // Строка y кольца (y может быть равен -1) - ее первый пиксель.
+        auto slot = [&](int y) { return luma.data() + ((y % 3 + 3) % 3) * padded + 1; };
+
+        auto load = [&](int y)
+        {
+            uint8_t* target = slot(y);
+            load_row(std::clamp(y, 0, height - 1), target);
+            target[-1] = target[0];
+            target[width] = target[width - 1];
+        };
+
+        load(y_begin - 1);
+        load(y_begin);
+
+        for (int y = y_begin; y < y_end; ++y)
+        {
+            load(y + 1);
+            gradientRow(slot(y - 1), slot(y), slot(y + 1), width, side, center, gx, gy, magnitude);
+            consume(y, gx, gy, magnitude);
+        }
+    }
+
+    /*  Вспомогательный метод (SIMD-ядро размытия): totals[x] += weight * source[x] для count байтов source.
+        В SSE2-версии 16-битные произведения собираются в 32-битные из младших (_mm_mullo_epi16)
+        и старших (_mm_mulhi_epi16) половин.  */
+    static void accumulateWeighted(const uint8_t* source, int count, int16_t weight, int32_t* totals)
+    {
+        int x = 0;
+
+#if defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i weights = _mm_set1_epi16(weight);
+
+        for (; x + 8 <= count; x += 8)
+        {
+            __m128i value = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(source + x)), zero);
+            __m128i low   = _mm_mullo_epi16(value, weights);
+            __m128i high  = _mm_mulhi_epi16(value, weights);
+
+            __m128i* target = reinterpret_cast<__m128i*>(totals + x);
+            _mm_storeu_si128(target, _mm_add_epi32(_mm_loadu_si128(target), _mm_unpacklo_epi16(low, high)));
+            _mm_storeu_si128(target + 1, _mm_add_epi32(_mm_loadu_si128(target + 1), _mm_unpackhi_epi16(low, high)));
+        }
+#endif
+
+        for (; x < count; ++x) { totals[x] += weight * source[x]; }
+    }
+
+    /*  Вспомогательный метод, который размывает полутоновое изображение image гауссовым фильтром с параметром sigma
+        (радиус ядра ceil(3 * sigma), веса в формате с фиксированной точкой, см. gaussianWeights): сначала по строкам
+        во временный буфер, затем по столбцам обратно в image (за границами продолжены крайние пиксели).
+        В обоих проходах суммы всей строки накапливаются по очереди от каждого веса ядра (см. accumulateWeighted).  */
+    static void blurGray(GrayImage& image, double sigma, unsigned thread_count)
+    {
+        const int width = image.width(), height = image.height();
+        const std::vector<int16_t> weights = gaussianWeights(sigma);
+        const int radius = static_cast<int>(weights.size() / 2);
+        const int32_t rounding = 1 << (fixed_point_bits - 1);
+        std::vector<uint8_t> horizontal(static_cast<size_t>(width) * height);
+
+        auto store = [&](const std::vector<int32_t>& totals, uint8_t* target) {
+            for (int x = 0; x < width; ++x) { target[x] = static_cast<uint8_t>(std::clamp(totals[x] >> fixed_point_bits, 0, 255)); }
+        };
+
+        const int band_count = (height + edge_band - 1) / edge_band;
+
+        // 1. По строкам (полосами по edge_band строк, рабочие буферы - один раз на полосу).
+        runParallel(band_count, thread_count, [&](int band)
+        {
+            std::vector<uint8_t> padded(width + 2 * radius);
+            std::vector<int32_t> totals(width);
+
+            for (int y = band * edge_band; y < std::min((band + 1) * edge_band, height); ++y)
+            {
+                for (int x = -radius; x < width + radius; ++x) { padded[x + radius] = image.row(y)[std::clamp(x, 0, width - 1)]; }
+
+                std::fill(totals.begin(), totals.end(), rounding);
+                for (int i = 0; i <= 2 * radius; ++i) { accumulateWeighted(padded.data() + i, width, weights[i], totals.data()); }
+
+                store(totals, horizontal.data() + static_cast<size_t>(y) * width);
+            }
+        });
+
+        // 2. По столбцам.
+        runParallel(band_count, thread_count, [&](int band)
+        {
+            std::vector<int32_t> totals(width);
+
+            for (int y = band * edge_band; y < std::min((band + 1) * edge_band, height); ++y)
+            {
+                std::fill(totals.begin(), totals.end(), rounding);
+                for (int i = -radius; i <= radius; ++i) {
+                    accumulateWeighted(horizontal.data() + static_cast<size_t>(std::clamp(y + i, 0, height - 1)) * width, width, weights[i + radius], totals.data());
+                }
+
+                store(totals, image.row(y));
+            }
+        });
+    }
+
+    // Вспомогательный метод, который возвращает значение ядра фильтра ресемплинга в точке x.
+    static double resampleKernel(ResampleFilter filter, double x)
+    {
+        x = std::fabs(x);
+
+        switch (filter)
+        {
+            case ResampleFilter::Bilinear:
+                return (x < 1.0) ? 1.0 - x : 0.0;
+
+            case ResampleFilter::Bicubic:
+                if (x < 1.0) { return (1.5 * x - 2.5) * x * x + 1.0; }
+                if (x < 2.0) { return ((-0.5 * x + 2.5) * x - 4.0) * x + 2.0; }
+                return 0.0;
+
+            default:
+            {
+                if (x < 1e-9) { return 1.0; }
+                if (x >= 3.0) { return 0.0; }
+
+                const double pi = 3.14159265358979323846;
+                return 3.0 * std::sin(pi * x) * std::sin(pi * x / 3.0) / (pi * pi * x * x);
+            }
+        }
+    }
+
+    /*  Вспомогательный метод, который строит таблицу весов для ресемплинга source_size элементов в target_size.
+        Центр выходного элемента i находится в точке (i + 0.5) * source_size / target_size исходной оси.
+        Элементы за границами оси заменяются крайними (их веса прибавляются к весам крайних элементов),
+        а округление весов до фиксированной точки компенсируется в наибольшем весе, чтобы сумма
+        весов была равна ровно 1.0 и однотонные области не меняли цвет.  */
+    static ResampleTable makeResampleTable(int source_size, int target_size, ResampleFilter filter)
+    {
+        const double radius = (filter == ResampleFilter::Bilinear) ? 1.0 : (filter == ResampleFilter::Bicubic) ? 2.0 : 3.0;
+        const double scale = static_cast<double>(source_size) / target_size;
+        const double filter_scale = std::max(scale, 1.0);
+        const double support = radius * filter_scale;
+
+        // 1. Вещественные веса для каждого выходного элемента (first[i] - индекс первого исходного элемента).
+        std::vector<std::vector<double>> weights(target_size);
+        std::vector<int> first(target_size);
+        int taps = 1;
+
+        for (int i = 0; i < target_size; ++i)
+        {
+            double center = (i + 0.5) * scale;
+            int raw_begin = static_cast<int>(std::floor(center - support));
+            int raw_end   = static_cast<int>(std::ceil(center + support));
+            int begin = std::clamp(raw_begin, 0, source_size - 1);
+            int end   = std::clamp(raw_end, begin + 1, source_size);
+
+            std::vector<double>& current = weights[i];
+            current.assign(end - begin, 0.0);
+
+            double sum = 0.0;
+            for (int j = raw_begin; j < raw_end; ++j)
+            {
+                double weight = resampleKernel(filter, (j + 0.5 - center) / filter_scale);
+                current[std::clamp(j, begin, end - 1) - begin] += weight;
+                sum += weight;
+            }
+
+            if (sum == 0.0) { std::fill(current.begin(), current.end(), 1.0); sum = current.size(); }
+            for (double& weight : current) { weight /= sum; }
+
+            first[i] = begin;
+            taps = std::max<int>(taps, current.size());
+        }
+
+        /* 2.   Все элементы таблицы имеют одинаковое число весов (taps): начало окна сдвигается так, чтобы
+                окно не выходило за границу оси, а лишние веса остаются нулевыми.  */
+        ResampleTable table;
+        table.taps = taps;
+        table.starts.resize(target_size);
+        table.weights.assign(static_cast<size_t>(target_size) * taps, 0);
+
+        for (int i = 0; i < target_size; ++i)
+        {
+            int start = std::min(first[i], source_size - taps);
+            int16_t* target = table.weights.data() + static_cast<size_t>(i) * taps;
+
+            int total = 0, largest = 0;
+            for (size_t k = 0; k < weights[i].size(); ++k)
+            {
+                int offset = first[i] - start + static_cast<int>(k);
+                target[offset] = static_cast<int16_t>(std::lround(weights[i][k] * (1 << fixed_point_bits)));
+                total += target[offset];
+
+                if (std::abs(target[offset]) > std::abs(target[largest])) { largest = offset; }
+            }
+
+            target[largest] = static_cast<int16_t>(target[largest] + (1 << fixed_point_bits) - total);
+            table.starts[i] = start;
+        }
+
+        return table;
+    }
+
+    /*  Вспомогательный метод, который открывает BMP-файл, считывает и проверяет его заголовки
+        и возвращает поток, позиция чтения которого находится в начале данных о пикселях.  */
+    std::ifstream openFile(const std::string& file_path)
+    {
+        // 1. Создаю входной поток для чтения входного файла.
+        std::ifstream inp_file(file_path, std::ios::in | std::ios::binary);
+
+        // 1.1 Если не смог открыть файл - выбрасываю исключение с соответствующим сообщением.
+        if (!inp_file) {
+            throw std::runtime_error("Error! It's not possible to open the file on the path: \"" + file_path + "\".");
+        }
+
+        /* 2.   Создаю функтор (с помощью лямбда-функции) для удобной проверки на возникновение ошибок при чтении файла.
+                При необходимости функтор выбрасывает исключение с соответствующим сообщением.  */
+        auto check_error = [&]() { if (inp_file.fail()) throw std::runtime_error("Oops! An error occurred while reading the file."); };
+
+        /* 3.   Считываю информацию из двух основных заголовков и заполняю поля объектов
+                моих структур соответствующей информацией. После чтения каждого блока проверяю наличие ошибок.   */
+        inp_file.read(reinterpret_cast<char*>(&file_header), sizeof(BMPFileHeader));
+        check_error();
+
+        inp_file.read(reinterpret_cast<char*>(&info_block), sizeof(BMPFileInfoBlock));
+        check_error();
+
+        /* 3.1  После получения информации о входном файле, обрабатываю случаи, 
+                которые могут привести к *непредвиденному* поведению программы.  */
+        if (file_header.type_of_file != 0x4D42) {
+            throw std::runtime_error("Error! The specified file is not of the BMP type.");
+        }
+
+        if (info_block.color_depth_in_bits != 24) {
+            throw std::runtime_error("Error! This class only works with images with a color depth of 24 bits.");
+        }
+
+        // 4. Внутри файла перемещаюсь к началу данных о пикселях.
+        inp_file.seekg(file_header.offset_to_pixel_data, std::ios::beg);
+        check_error();
+
+        return inp_file;
+    }
+
+    /*  Вспомогательный метод, который записывает в файл file_path изображение width x height, строки которого
+        (сверху вниз) начинаются по указателям rows. Заголовки заполняются через makeHeaders.  */
+    void writeFile(const std::string& file_path, const uint32_t* const* rows, int width, int height) const
+    {
+        std::ofstream out_file(file_path, std::ios::out | std::ios::trunc | std::ios::binary);
+
+        if (!out_file) {
+            throw std::runtime_error("Error! It's not possible to open the file on the path: \"" + file_path + "\".");
+        }
+
+        BMPFileHeader header;
+        BMPFileInfoBlock info;
+        makeHeaders(file_header, info_block, width, height, 24, 0, header, info);
+
+        out_file.write(reinterpret_cast<char*>(&header), sizeof(BMPFileHeader));
+        out_file.write(reinterpret_cast<char*>(&info), sizeof(BMPFileInfoBlock));
+
+        std::vector<uint8_t> row_data(((width * 24 + 31) / 32) * 4, 0);
+
+        for (int y = height - 1; y >= 0; --y)
+        {
+            encodeRow(rows[y], width, row_data.data());
+            out_file.write(reinterpret_cast<char*>(row_data.data()), row_data.size());
+        }
+
+        // Ошибка записи (например, закончилось место на диске) иначе потерялась бы при закрытии потока.
+        out_file.close();
+        if (out_file.fail()) { throw std::runtime_error("Oops! An error occurred while writing the file \"" + file_path + "\"."); }
+    }
+
+    /*  Вспомогательный метод, который записывает в файл file_path изображение с палитрой: bits_per_pixel бит на пиксель,
+        строки (сверху вниз) уже упакованы так, как в файле, и лежат подряд в data с шагом stride. Заголовки строятся
+        из source_header и source_info (см. makeHeaders), поэтому объект-редактор для записи не нужен.  */
+    static void writeIndexedFile(const std::string& file_path, const BMPFileHeader& source_header, const BMPFileInfoBlock& source_info,
+                                 const uint8_t* data, size_t stride, int width, int height, int bits_per_pixel, const std::vector<uint32_t>& palette)
+    {
+        std::ofstream out_file(file_path, std::ios::out | std::ios::trunc | std::ios::binary);
+
+        if (!out_file) {
+            throw std::runtime_error("Error! It's not possible to open the file on the path: \"" + file_path + "\".");
+        }
+
+        BMPFileHeader header;
+        BMPFileInfoBlock info;
+        makeHeaders(source_header, source_info, width, height, bits_per_pixel, palette.size(), header, info);
+
+        out_file.write(reinterpret_cast<char*>(&header), sizeof(BMPFileHeader));
+        out_file.write(reinterpret_cast<char*>(&info), sizeof(BMPFileInfoBlock));
+
+        // Элементы палитры записываются в порядке байтов синий, зеленый, красный, 0 - как и пиксели в памяти (0x00BBGGRR).
+        for (uint32_t color : palette)
+        {
+            uint8_t entry[4] = { static_cast<uint8_t>(color >> 16), static_cast<uint8_t>(color >> 8), static_cast<uint8_t>(color), 0 };
+            out_file.write(reinterpret_cast<char*>(entry), 4);
+        }
+
+        size_t row_size = ((static_cast<size_t>(width) * bits_per_pixel + 31) / 32) * 4;
+        for (int y = height - 1; y >= 0; --y) { out_file.write(reinterpret_cast<const char*>(data + y * stride), row_size); }
+
+        out_file.close();
+        if (out_file.fail()) { throw std::runtime_error("Oops! An error occurred while writing the file \"" + file_path + "\"."); }
+    }
+
+    // Вспомогательный метод, который записывает в файл file_path планарное изображение image с заголовками на основе source_header и source_info.
+    static void writePlanarFile(const std::string& file_path, const BMPFileHeader& source_header, const BMPFileInfoBlock& source_info, const PlanarImage& image)
+    {
+        std::ofstream out_file(file_path, std::ios::out | std::ios::trunc | std::ios::binary);
+
+        if (!out_file) {
+            throw std::runtime_error("Error! It's not possible to open the file on the path: \"" + file_path + "\".");
+        }
+
+        BMPFileHeader header;
+        BMPFileInfoBlock info;
+        makeHeaders(source_header, source_info, image.width(), image.height(), 24, 0, header, info);
+
+        out_file.write(reinterpret_cast<char*>(&header), sizeof(BMPFileHeader));
+        out_file.write(reinterpret_cast<char*>(&info), sizeof(BMPFileInfoBlock));
+
+        // Строки файла (снизу вверх) собираются прямо из плоскостей; байты выравнивания остаются нулевыми.
+        std::vector<uint8_t> row_data(((image.width() * 24 + 31) / 32) * 4, 0);
+
+        for (int y = image.height() - 1; y >= 0; --y)
+        {
+            encodePlanarRow(image.row(PlanarImage::blue, y), image.row(PlanarImage::green, y), image.row(PlanarImage::red, y), image.width(), row_data.data());
+            out_file.write(reinterpret_cast<char*>(row_data.data()), row_data.size());
+        }
+
+        out_file.close();
+        if (out_file.fail()) { throw std::runtime_error("Oops! An error occurred while writing the file \"" + file_path + "\"."); }
+    }
+
+    // Размер блока (в пикселях), которым выполняются повороты и транспонирования.
+    static const int orientation_block = 32;
+
+    // Вспомогательный метод: меняет ли ориентация местами ширину и высоту изображения.
+    static bool isTransposing(Orientation orientation)
+    {
+        return orientation == Orientation::Rotate90 || orientation == Orientation::Rotate270 ||
+               orientation == Orientation::Transpose || orientation == Orientation::Transverse;
+    }
+
+    /*  Вспомогательный метод, который записывает в destination[0], destination[1], ... строки с y_begin по y_end
+        изображения, повернутого (отраженного) согласно orientation. Для транспонирующих ориентаций строка
+        результата - это столбец исходного изображения, поэтому строки собираются блоками orientation_block
+        столбцов: внутри блока читаются orientation_block исходных строк по orientation_block подряд идущих пикселей.  */
+    void orientRows(Orientation orientation, int y_begin, int y_end, std::vector<uint32_t>* destination) const
+    {
+        const int width  = info_block.width;
+        const int height = info_block.height;
+
+        if (!isTransposing(orientation))
+        {
+            bool flip_x = orientation == Orientation::FlipHorizontal || orientation == Orientation::Rotate180;
+            bool flip_y = orientation == Orientation::FlipVertical || orientation == Orientation::Rotate180;
+
+            for (int y = y_begin; y < y_end; ++y)
+            {
+                const std::vector<uint32_t>& source = pixels[flip_y ? height - 1 - y : y];
+
+                if (flip_x) { std::reverse_copy(source.begin(), source.end(), destination[y - y_begin].begin()); }
+                else        { std::copy(source.begin(), source.end(), destination[y - y_begin].begin()); }
+            }
+
+            return;
+        }
+
+        /*  Пиксель (x, y) результата берется из столбца sx = y (или width - 1 - y) и строки sy = x (или height - 1 - x):
+                Transpose  -> sx = y,             sy = x;
+                Rotate90   -> sx = y,             sy = height - 1 - x;  (поворот по часовой стрелке)
+                Rotate270  -> sx = width - 1 - y, sy = x;
+                Transverse -> sx = width - 1 - y, sy = height - 1 - x.  */
+        bool reverse_columns = orientation == Orientation::Rotate270 || orientation == Orientation::Transverse;
+        bool reverse_rows    = orientation == Orientation::Rotate90 || orientation == Orientation::Transverse;
+
+        for (int x_block = 0; x_block < height; x_block += orientation_block)
+        {
+            int x_end = std::min(x_block + orientation_block, height);
+
+            for (int y = y_begin; y < y_end; ++y)
+            {
+                int source_x = reverse_columns ? width - 1 - y : y;
+                uint32_t* target = destination[y - y_begin].data();
+
+                for (int x = x_block; x < x_end; ++x) { target[x] = pixels[reverse_rows ? height - 1 - x : x][source_x]; }
+            }
+        }
+    }
+
+    /*  Вспомогательный метод, который заполняет заголовки для сохранения изображения размера width x height
+        с глубиной цвета bits_per_pixel и палитрой из palette_size цветов (палитра идет сразу после заголовков).
+        Остальные поля (например, разрешение) копируются из заголовков исходного изображения source_header и source_info.  */
+    static void makeHeaders(const BMPFileHeader& source_header, const BMPFileInfoBlock& source_info, int width, int height,
+                            int bits_per_pixel, int palette_size, BMPFileHeader& header, BMPFileInfoBlock& info)
+    {
+        uint32_t row_stride = ((width * bits_per_pixel + 31) / 32) * 4;
+
+        header = source_header;
+        header.type_of_file = 0x4D42;
+        header.offset_to_pixel_data = sizeof(BMPFileHeader) + sizeof(BMPFileInfoBlock) + 4 * palette_size;
+        header.size_of_file = header.offset_to_pixel_data + row_stride * height;
+
+        info = source_info;
+        info.size_of_info_block = sizeof(BMPFileInfoBlock);
+        info.width = width;
+        info.height = height;
+        info.count_of_planes = 1;
+        info.color_depth_in_bits = bits_per_pixel;
+        info.type_of_compression = 0;
+        info.size_of_image = row_stride * height;
+        info.count_of_colors = palette_size;
+        info.count_of_important_colors = 0;
+    }
+
+    // Сглаженная линия по алгоритму Ву (см. drawLineAA).
+    void rasterizeLineAA(int x0, int y0, int x1, int y1, uint32_t color, uint32_t alpha, int row_begin, int row_end)
+    {
+        /* 1.   Если линия "крутая" (по y она длиннее, чем по x), то меняю роли осей местами:
+                тогда шаг всегда делается по длинной оси, а сглаживаются соседние пиксели по короткой.  */
+        bool steep = std::abs(y1 - y0) > std::abs(x1 - x0);
+        if (steep) {
+            std::swap(x0, y0);
+            std::swap(x1, y1);
+        }
+
+        if (x0 > x1) {
+            std::swap(x0, x1);
+            std::swap(y0, y1);
+        }
+
+        // 2. Вычисляю наклон линии в формате 16.16 (целая часть - старшие 16 бит, дробная - младшие).
+        int64_t dx = x1 - x0;
+        int64_t dy = y1 - y0;
+        int64_t gradient = (dx == 0) ? 0 : (dy << 16) / dx;
+
+        // 3. Определяю допустимые диапазоны по длинной (major) и короткой (minor) осям.
+        int major_begin = steep ? row_begin : 0;
+        int major_end   = steep ? row_end : static_cast<int>(info_block.width);
+        int minor_begin = steep ? 0 : row_begin;
+        int minor_end   = steep ? static_cast<int>(info_block.width) : row_end;
+
+        int x_begin = std::max(x0, major_begin);
+        int x_end   = std::min(x1, major_end - 1);
+
+        /* 3.1  Для пологой линии дополнительно сужаю диапазон по x до участка, на котором
+                линия проходит через разрешенные строки (важно при отрисовке по полосам).  */
+        if (!steep)
+        {
+            if (gradient == 0)
+            {
+                if (y0 < minor_begin - 1 || y0 >= minor_end) { return; }
+            }
+            else
+            {
+                int64_t xa = x0 + ((static_cast<int64_t>(minor_begin - 1 - y0) << 16) / gradient);
+                int64_t xb = x0 + ((static_cast<int64_t>(minor_end - y0) << 16) / gradient);
+
+                x_begin = static_cast<int>(std::max<int64_t>(x_begin, std::min(xa, xb) - 1));
+                x_end   = static_cast<int>(std::min<int64_t>(x_end, std::max(xa, xb) + 1));
+            }
+        }
+
+        // 4. Сдвигаю начальную координату по короткой оси на участок, который был отсечен.
+        int64_t intery = (static_cast<int64_t>(y0) << 16) + gradient * (x_begin - x0);
+
+        // 5. Функтор, который ставит пиксель с учетом перестановки осей и границ.
+        auto plot = [&](int major, int minor, uint32_t coverage)
+        {
+            if (minor < minor_begin || minor >= minor_end) { return; }
+
+            // Итоговая непрозрачность пикселя = покрытие * непрозрачность линии / 255.
+            coverage = coverage * alpha + 128;
+            coverage = (coverage + (coverage >> 8)) >> 8;
+            if (coverage == 0) { return; }
+
+            if (steep) { blendPixel(minor, major, color, coverage); }
+            else       { blendPixel(major, minor, color, coverage); }
+        };
+
+        /* 6.   Основной цикл: на каждом шаге линия проходит между двумя соседними пикселями.
+                Верхний получает покрытие (1 - дробная часть), нижний - дробную часть.  */
+        for (int x = x_begin; x <= x_end; ++x, intery += gradient)
+        {
+            int y = static_cast<int>(intery >> 16);
+            uint32_t fraction = static_cast<uint32_t>(intery >> 8) & 0xFF;
+
+            plot(x, y, 255 - fraction);
+            plot(x, y + 1, fraction);
+        }
+    }
+
+    // Закрашенный прямоугольник (см. fillRect).
+    void rasterizeRect(int x, int y, int width, int height, uint32_t color, uint32_t alpha, int row_begin, int row_end)
+    {
+        // Строки за пределами диапазона пропускаю сразу, остальные заливаю целыми отрезками.
+        int y_begin = std::max(y, row_begin);
+        int y_end   = std::min(y + height, row_end);
+
+        for (int row = y_begin; row < y_end; ++row) { fillSpan(row, x, x + width, color, alpha); }
+    }
+
+    // Контур прямоугольника толщиной в один пиксель.
+    void rasterizeBox(int x, int y, int width, int height, uint32_t color, uint32_t alpha, int row_begin, int row_end)
+    {
+        if (width <= 0 || height <= 0) { return; }
+
+        int y_begin = std::max(y, row_begin);
+        int y_end   = std::min(y + height, row_end);
+
+        for (int row = y_begin; row < y_end; ++row)
+        {
+            // Верхняя и нижняя стороны - целые отрезки, на остальных строках - только два крайних пикселя.
+            if (row == y || row == y + height - 1) { fillSpan(row, x, x + width, color, alpha); }
+            else
+            {
+                fillSpan(row, x, x + 1, color, alpha);
+                fillSpan(row, x + width - 1, x + width, color, alpha);
+            }
+        }
+    }
+
+    // Маркер-крестик (две диагонали) с центром (center_x, center_y) и полуразмером half_size.
+    void rasterizeCross(int center_x, int center_y, int half_size, uint32_t color, uint32_t alpha, int row_begin, int row_end)
+    {
+        int y_begin = std::max(center_y - half_size, row_begin);
+        int y_end   = std::min(center_y + half_size + 1, row_end);
+
+        for (int y = y_begin; y < y_end; ++y)
+        {
+            int offset = y - center_y;
+
+            fillSpan(y, center_x + offset, center_x + offset + 1, color, alpha);
+            fillSpan(y, center_x - offset, center_x - offset + 1, color, alpha);
+        }
+    }
+
+    // Закрашенный эллипс (см. fillEllipse).
+    void rasterizeEllipse(int center_x, int center_y, int radius_x, int radius_y, uint32_t color, uint32_t alpha, int row_begin, int row_end)
+    {
+        int y_begin = std::max(center_y - radius_y, row_begin);
+        int y_end   = std::min(center_y + radius_y + 1, row_end);
+
+        for (int y = y_begin; y < y_end; ++y)
+        {
+            /*  Пиксель (x, y) лежит внутри эллипса, если (dx / rx)^2 + (dy / ry)^2 <= 1.
+                Отсюда максимальное |dx| для строки: rx * sqrt(1 - (dy / ry)^2).  */
+            int dy = y - center_y;
+            int half_width = radius_x;
+
+            if (radius_y > 0)
+            {
+                double ratio = static_cast<double>(dy) / radius_y;
+                half_width = static_cast<int>(std::floor(radius_x * std::sqrt(std::max(0.0, 1.0 - ratio * ratio)) + 1e-9));
+            }
+
+            fillSpan(y, center_x - half_width, center_x + half_width + 1, color, alpha);
+        }
+    }
+
+    // Закрашенный многоугольник по правилу "чет-нечет" (см. fillPolygon).
+    void rasterizePolygon(const std::vector<Point>& vertices, uint32_t color, uint32_t alpha, int row_begin, int row_end)
+    {
+        /*  0.  Вырожденный многоугольник (меньше трех вершин или все вершины на одной строке) не содержит
+                ни одного центра пикселя -> рисовать нечего, а таблица ребер для него была бы пустой.  */
+        if (vertices.size() < 3) { return; }
+
+        auto [lowest, highest] = std::minmax_element(vertices.begin(), vertices.end(),
+                                                     [](const Point& l, const Point& r) { return l.y < r.y; });
+        if (lowest->y == highest->y) { return; }
+
+        /*  1.  Описание ребра: верхняя и нижняя строки (нижняя не включается), координата x
+                пересечения с центром текущей строки и ее приращение на строку (оба - в формате 16.16).  */
+        struct Edge
+        {
+            int y_top;
+            int y_bottom;
+            int64_t x;
+            int64_t slope;
+        };
+
+        // 2. Строю таблицу ребер. Горизонтальные ребра не пересекают центры строк, поэтому их пропускаю.
+        std::vector<Edge> edges;
+        edges.reserve(vertices.size());
+
+        for (size_t i = 0; i < vertices.size(); ++i)
+        {
+            Point a = vertices[i];
+            Point b = vertices[(i + 1) % vertices.size()];
+
+            if (a.y == b.y) { continue; }
+            if (a.y > b.y) { std::swap(a, b); }
+
+            int64_t slope = static_cast<int64_t>(b.x - a.x) * 65536 / (b.y - a.y);
+            edges.push_back({ a.y, b.y, static_cast<int64_t>(a.x) * 65536, slope });
+        }
+
+        if (edges.empty()) { return; }
+
+        std::sort(edges.begin(), edges.end(), [](const Edge& l, const Edge& r) { return l.y_top < r.y_top; });
+
+        // 3. Определяю диапазон строк, которые нужно обработать (с учетом разрешенного диапазона).
+        int y_begin = std::max(edges.front().y_top, row_begin);
+        int y_end = row_begin;
+        for (const Edge& edge : edges) { y_end = std::max(y_end, edge.y_bottom); }
+        y_end = std::min(y_end, row_end);
+
+        std::vector<Edge> active;
+        size_t next_edge = 0;
+
+        for (int y = y_begin; y < y_end; ++y)
+        {
+            /* 3.1  Добавляю ребра, которые начались на этой строке (или выше, если многоугольник
+                    выходит за верхнюю границу диапазона). Пересечение сразу считаю для центра строки y.  */
+            while (next_edge < edges.size() && edges[next_edge].y_top <= y)
+            {
+                Edge edge = edges[next_edge++];
+                edge.x += edge.slope * (y - edge.y_top) + edge.slope / 2;
+                active.push_back(edge);
+            }
+
+            // 3.2 Удаляю ребра, которые уже закончились.
+            active.erase(std::remove_if(active.begin(), active.end(),
+                                        [y](const Edge& edge) { return edge.y_bottom <= y; }),
+                         active.end());
+
+            /* 3.3  Сортирую активные ребра по x. От строки к строке порядок меняется мало,
+                    поэтому сортировка вставками здесь работает почти за линейное время.  */
+            for (size_t i = 1; i < active.size(); ++i)
+            {
+                Edge edge = active[i];
+                size_t j = i;
+                for (; j > 0 && active[j - 1].x > edge.x; --j) { active[j] = active[j - 1]; }
+                active[j] = edge;
+            }
+
+            /* 3.4  Заливаю отрезки между парами пересечений. Пиксель x закрашивается,
+                    если его центр (x + 0.5) лежит в промежутке [x_left, x_right).  */
+            for (size_t i = 0; i + 1 < active.size(); i += 2)
+            {
+                int x_begin = static_cast<int>((active[i].x     - 0x8000 + 0xFFFF) >> 16);
+                int x_end   = static_cast<int>((active[i + 1].x - 0x8000 + 0xFFFF) >> 16);
+
+                fillSpan(y, x_begin, x_end, color, alpha);
+            }
+
+            // 3.5 Переношу пересечения на следующую строку.
+            for (Edge& edge : active) { edge.x += edge.slope; }
+        }
+    }
+
+    // Вспомогательный метод, который определяет диапазон строк [top, bottom], задеваемых примитивом.
+    static void commandRows(const DrawCommand& command, int& top, int& bottom)
+    {
+        switch (command.type)
+        {
+            case DrawCommand::Type::Line:
+                top    = std::min(command.y0, command.y1) - 1;
+                bottom = std::max(command.y0, command.y1) + 1;
+                break;
+
+            case DrawCommand::Type::Box:
+            case DrawCommand::Type::FilledRect:
+                top    = command.y0;
+                bottom = command.y0 + command.y1 - 1;
+                break;
+
+            case DrawCommand::Type::Cross:
+                top    = command.y0 - command.x1;
+                bottom = command.y0 + command.x1;
+                break;
+
+            case DrawCommand::Type::Ellipse:
+                top    = command.y0 - command.y1;
+                bottom = command.y0 + command.y1;
+                break;
+
+            case DrawCommand::Type::Polygon:
+                top = bottom = command.vertices.empty() ? -1 : command.vertices.front().y;
+                for (const Point& vertex : command.vertices)
+                {
+                    top    = std::min(top, vertex.y);
+                    bottom = std::max(bottom, vertex.y);
+                }
+                break;
+        }
+    }
+
+    // Вспомогательный метод, который рисует один примитив из пакета в строках [row_begin, row_end).
+    void rasterizeCommand(const DrawCommand& command, int row_begin, int row_end)
+    {
+        switch (command.type)
+        {
+            case DrawCommand::Type::Line:
+                rasterizeLineAA(command.x0, command.y0, command.x1, command.y1, command.color, command.alpha, row_begin, row_end);
+                break;
+
+            case DrawCommand::Type::Box:
+                rasterizeBox(command.x0, command.y0, command.x1, command.y1, command.color, command.alpha, row_begin, row_end);
+                break;
+
+            case DrawCommand::Type::FilledRect:
+                rasterizeRect(command.x0, command.y0, command.x1, command.y1, command.color, command.alpha, row_begin, row_end);
+                break;
+
+            case DrawCommand::Type::Cross:
+                rasterizeCross(command.x0, command.y0, command.x1, command.color, command.alpha, row_begin, row_end);
+                break;
+
+            case DrawCommand::Type::Ellipse:
+                if (command.x1 >= 0 && command.y1 >= 0) {
+                    rasterizeEllipse(command.x0, command.y0, command.x1, command.y1, command.color, command.alpha, row_begin, row_end);
+                }
+                break;
+
+            case DrawCommand::Type::Polygon:
+                rasterizePolygon(command.vertices, command.color, command.alpha, row_begin, row_end);
+                break;
         }
     }
 };